@@ -0,0 +1,71 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BLOBS_H_INCLUDED
+#define BLOBS_H_INCLUDED
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// Blob describes a connected group of foreground pixels of the part mask
+struct Blob
+{
+    cv::Rect rect;
+    // number of pixels and center of mass, only known with BLOBS_COMPONENTS where the labeling
+    // provides them for free. The part selection only needs rect.
+    int area;
+    cv::Point2d centroid;
+};
+
+// BlobMethod selects how the blobs are extracted from the mask
+enum BlobMethod
+{
+    // findContours on the outer contours, then boundingRect of each contour
+    BLOBS_CONTOURS,
+    // connectedComponentsWithStats, a single labeling pass without per-contour point vectors
+    BLOBS_COMPONENTS
+};
+
+// BlobWorkspace keeps the buffers of findBlobs so they are reused from one frame to the next
+struct BlobWorkspace
+{
+    std::vector<std::vector<cv::Point> > contours;
+    std::vector<cv::Vec4i> hierarchy;
+    cv::Mat labels;
+    cv::Mat stats;
+    cv::Mat centroids;
+};
+
+// findBlobs replaces the content of blobs with the 8-connected blobs of the binary mask
+void findBlobs(const cv::Mat& mask, BlobMethod method, BlobWorkspace& ws, std::vector<Blob>& blobs);
+
+// selectPart picks the blob of the mask with the largest bounding box that is large enough and completely
+// within the processed area, with no overlapping edge. Parts move horizontally, so only the left and right
+// edges are checked unless bounded is set for a region of interest, then the top and bottom ones are too.
+// edge, when not empty, marks the pixels on the outline of a polygonal region: a blob with a pixel there
+// crosses the outline. It returns the bounding box area, 0 if there is no such blob.
+int selectPart(const std::vector<Blob>& blobs, const cv::Mat& mask, const cv::Mat& edge, bool bounded,
+               cv::Rect& rect);
+
+#endif
@@ -0,0 +1,66 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef BUFFER_POOL_H_INCLUDED
+#define BUFFER_POOL_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+
+#include <opencv2/core.hpp>
+
+// BufferPool recycles image buffers so the per-frame work does not allocate once warmed up.
+// A buffer is handed out by sharing it, and it is free again once every Mat sharing it was
+// released, which OpenCV tracks with the reference count of the data. So a captured frame can
+// be passed down the pipeline (ring, worker, display) without copies, and nobody has to give
+// buffers back explicitly.
+// A BufferPool is used by one thread at a time, the Mats it hands out may go anywhere.
+class BufferPool
+{
+public:
+    BufferPool();
+
+    // acquire returns a Mat of the given size and type on a buffer no other Mat shares, its
+    // content is undefined. A free buffer of the same size and type is reused, otherwise a
+    // free buffer is reallocated or the pool grows.
+    cv::Mat acquire(cv::Size size, int type);
+
+    size_t size() const { return buffers.size(); }
+
+    // allocated counts the buffers allocated by every pool, reused those handed out again
+    static uint64_t allocated() { return allocated_count.load(std::memory_order_relaxed); }
+    static uint64_t reused() { return reused_count.load(std::memory_order_relaxed); }
+
+private:
+    bool isFree(cv::Mat& m) const;
+
+    // a deque so growing does not move the buffers, and their headers, around
+    std::deque<cv::Mat> buffers;
+    size_t next;
+
+    static std::atomic<uint64_t> allocated_count;
+    static std::atomic<uint64_t> reused_count;
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef EVENTS_H_INCLUDED
+#define EVENTS_H_INCLUDED
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// PartEventType tells what happened to the part in view of a stream
+enum PartEventType
+{
+    PART_NEW,
+    PART_DEFECT,
+    PART_LEFT
+};
+
+const char* partEventName(PartEventType type);
+
+// PartEvent is emitted by the frame processing when a part enters the frame, is confirmed
+// as defective or leaves the frame
+struct PartEvent
+{
+    int stream;
+    PartEventType type;
+    int area;
+    cv::Rect rect;
+    int total_parts;
+    int total_defects;
+    // milliseconds since the epoch
+    int64_t timestamp;
+};
+
+// EventQueue hands part events from the frame workers to the MQTT publisher
+class EventQueue
+{
+public:
+    EventQueue();
+
+    void push(const PartEvent& event);
+    // wait waits up to timeout for an event, then moves all the queued events to the end of events.
+    // It returns false if nothing was queued before the timeout or the queue was shut down.
+    bool wait(std::vector<PartEvent>& events, std::chrono::milliseconds timeout);
+    // shutdown wakes up the waiting publisher for good
+    void shutdown();
+
+private:
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<PartEvent> queue;
+    bool stopped;
+};
+
+// coalesceEvents keeps only the latest event of each type for each stream, in their original order
+void coalesceEvents(std::vector<PartEvent>& events);
+
+#endif
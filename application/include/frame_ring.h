@@ -0,0 +1,79 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef FRAME_RING_H_INCLUDED
+#define FRAME_RING_H_INCLUDED
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include <opencv2/core.hpp>
+
+#include "work_signal.h"
+
+// FrameRing is a fixed-capacity single-producer/single-consumer queue of video frames.
+// The slots are allocated once up front and handed over with atomic sequence numbers,
+// so neither side takes a lock. When the ring is full the producer either discards
+// the oldest queued frame (OVERWRITE_OLDEST) or sleeps until the consumer frees a slot (BLOCK).
+class FrameRing
+{
+public:
+    enum Policy { OVERWRITE_OLDEST, BLOCK };
+
+    FrameRing(size_t capacity, Policy policy);
+
+    // push queues a frame, returns false if the ring was closed while waiting for space
+    bool push(const cv::Mat& frame);
+    // pop dequeues the oldest frame, returns false if the ring is empty
+    bool pop(cv::Mat& frame);
+    // close wakes up a producer blocked in push
+    void close();
+
+    size_t size() const;
+    size_t capacity() const { return n; }
+    Policy policy() const { return mode; }
+    uint64_t pushed() const { return pushed_count.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return dropped_count.load(std::memory_order_relaxed); }
+
+private:
+    // seq is 2*p while the slot is free for position p and 2*p+1 once it holds position p
+    struct Slot
+    {
+        std::atomic<uint64_t> seq;
+        cv::Mat mat;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t n;
+    Policy mode;
+    std::atomic<bool> closed;
+    std::atomic<uint64_t> head;
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> pushed_count;
+    std::atomic<uint64_t> dropped_count;
+    // posted by pop when a slot is freed, for a producer waiting in BLOCK mode
+    WorkSignal space;
+};
+
+#endif
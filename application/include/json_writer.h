@@ -0,0 +1,62 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef JSON_WRITER_H_INCLUDED
+#define JSON_WRITER_H_INCLUDED
+
+#include <cstddef>
+
+// maximum size of a payload built with JsonWriter
+#define PAYLOAD_MAX 1024
+
+// JsonWriter builds a flat JSON object of string values, {"Key": "value", ...}, into a fixed
+// buffer it owns. It does not allocate nor use iostreams, so a writer on the stack of the
+// publishing thread is all a message payload costs.
+class JsonWriter
+{
+public:
+    JsonWriter();
+
+    JsonWriter& field(const char* key, const char* value);
+    // numbers are written as strings too, like the rest of the payload values
+    JsonWriter& field(const char* key, long long value);
+
+    // c_str closes the object and returns the payload
+    const char* c_str();
+    size_t size() const { return len; }
+    // ok is false if the payload did not fit in the buffer
+    bool ok() const { return !overflow; }
+
+private:
+    void append(const char* s, size_t n);
+    void appendString(const char* s);
+    void key(const char* name);
+
+    char buf[PAYLOAD_MAX];
+    size_t len;
+    bool first;
+    bool closed;
+    bool overflow;
+};
+
+#endif
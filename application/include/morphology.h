@@ -0,0 +1,47 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef MORPHOLOGY_H_INCLUDED
+#define MORPHOLOGY_H_INCLUDED
+
+#include <opencv2/core.hpp>
+
+// The 3x3 MORPH_ELLIPSE structuring element is a cross, so erosion and dilation only need
+// the min/max of a pixel, its left and right neighbours and the pixels above and below.
+// These functions implement it on 8-bit single channel data with SSE2 or AVX2 (picked at
+// runtime) and give the same result as morphologyEx with the default constant border,
+// which leaves pixels outside the image out of the min/max.
+
+// erodeCrossRow/dilateCrossRow compute one output row from the three input rows around it.
+// up and down are null on the first and last row of the image; out must not alias the inputs.
+void erodeCrossRow(const uchar* up, const uchar* mid, const uchar* down, uchar* out, int width);
+void dilateCrossRow(const uchar* up, const uchar* mid, const uchar* down, uchar* out, int width);
+
+// erodeCross/dilateCross apply the cross to a whole image, dst may be the same as src
+void erodeCross(const cv::Mat& src, cv::Mat& dst);
+void dilateCross(const cv::Mat& src, cv::Mat& dst);
+
+// morphologyCross runs MORPH_OPEN or MORPH_CLOSE with the cross, tmp holds the intermediate image
+void morphologyCross(const cv::Mat& src, cv::Mat& dst, int op, cv::Mat& tmp);
+
+#endif
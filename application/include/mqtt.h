@@ -31,6 +31,7 @@
 #include <vector>
 #include <tuple>
 #include <cstring>
+#include <cstdint>
 
 extern "C" {
     #include "MQTTClient.h"
@@ -39,6 +40,17 @@ extern "C" {
 
 #define QOS 1
 #define TIMEOUT 1000L
+// maximum number of messages waiting to be sent, further messages are dropped
+#define MAX_QUEUED 1000
+// maximum number of QoS 1 messages sent but not yet acknowledged by the broker
+#define MAX_INFLIGHT 10
+// number of seconds a connection attempt may take
+#define CONNECT_TIMEOUT 5
+// bounds of the backoff between reconnection attempts, in milliseconds
+#define RECONNECT_MIN_MS 500L
+#define RECONNECT_MAX_MS 30000L
+// number of milliseconds between batches of messages sent from the outbox
+#define OUTBOX_BATCH_MS 100
 
 struct mqtt_service_config
 {
@@ -52,13 +64,56 @@ struct mqtt_service_config
     std::string ca_root;
 };
 
+// mqtt_state is the state of the connection to the broker
+enum mqtt_state
+{
+    MQTT_DISCONNECTED,
+    MQTT_CONNECTING,
+    MQTT_CONNECTED
+};
+
+// mqtt_stats counts what happened to the published messages
+struct mqtt_stats
+{
+    uint64_t queued;
+    uint64_t dropped;
+    uint64_t published;
+    uint64_t delivered;
+    uint64_t failed;
+    // connections made by the reconnect supervisor, and failed connection attempts
+    uint64_t reconnects;
+    uint64_t connect_failures;
+    // saved to the outbox, sent from the outbox, lost because the outbox was full, and lost because
+    // they were larger than the whole outbox
+    uint64_t stored;
+    uint64_t drained;
+    uint64_t overwritten;
+    uint64_t oversize;
+    int inflight;
+    size_t queue_depth;
+    size_t outbox_depth;
+    mqtt_state state;
+};
+
 std::string std_getenv(const std::string &name);
 std::pair<mqtt_service_config, bool> get_mqtt_config();
 int mqtt_start(MQTTClient_messageArrived* msgrcv);
 void mqtt_close();
-void mqtt_connect();
+// mqtt_connect connects to the broker and keeps reconnecting whenever the connection is lost or the
+// first attempt failed, it returns the paho return code of the first attempt
+int mqtt_connect();
 void mqtt_disconnect();
+// mqtt_publish queues the message for the sender thread and returns immediately, -1 if it was not queued
 int mqtt_publish(std::string const &topic, std::string const &message);
+int mqtt_publish(const char *topic, const char *payload, size_t len);
+mqtt_stats mqtt_get_stats();
+mqtt_state mqtt_get_state();
+const char* mqtt_state_name(mqtt_state state);
+// mqtt_open_outbox keeps the messages published while the broker is unreachable in the file at path,
+// up to size bytes of them, and sends them at drain_rate messages per second once connected.
+// It must be called before mqtt_start, it returns -1 if the file could not be opened.
+int mqtt_open_outbox(std::string const &path, size_t size, int drain_rate);
+// mqtt_subscribe subscribes to the topic now if connected, and again on every reconnection
 void mqtt_subscribe(std::string const &topic);
 
 #endif
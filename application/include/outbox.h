@@ -0,0 +1,97 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef OUTBOX_H_INCLUDED
+#define OUTBOX_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+// smallest outbox, in bytes
+#define OUTBOX_MIN_SIZE 4096
+
+// Outbox is a bounded FIFO of MQTT messages kept in a memory-mapped file, so the messages
+// published while the broker is unreachable survive a restart of the process. The file is a
+// header followed by a ring of records, each holding one message in its size rounded up to 8 bytes,
+// so a batch of many events or the statistics of many streams fit as well as a single event.
+// Messages are numbered in push order and stay in the outbox until they are removed, which may happen
+// in any order: the space of a removed message is reused once every older one was removed as well.
+// push and remove only touch the records and the header. When full, push overwrites the oldest
+// messages until the new one fits.
+// Outbox is not thread safe, its user serializes the calls.
+class Outbox
+{
+public:
+    Outbox();
+    ~Outbox();
+
+    // open maps the outbox file at path, creating it with room for size bytes of messages. The
+    // messages of an existing file are kept if it was created with the same size.
+    bool open(const std::string& path, size_t size);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    // push appends message number end(), it returns false if the message is larger than the whole outbox
+    bool push(const char* topic, size_t topic_len, const char* payload, size_t payload_len);
+    // get copies message number seq, it returns false if the message was removed or overwritten
+    bool get(uint64_t seq, std::string& topic, std::string& payload) const;
+    // remove deletes message number seq
+    void remove(uint64_t seq);
+
+    // first is the number of the oldest message kept, end the number of the next message pushed
+    uint64_t first() const;
+    uint64_t end() const;
+    // number of messages not removed yet
+    size_t size() const;
+    // number of bytes taken by the messages
+    size_t bytes() const;
+    // number of messages overwritten because the outbox was full
+    uint64_t overwritten() const { return overwritten_count; }
+
+private:
+    struct Header;
+    struct Record;
+
+    static size_t recordSize(size_t topic_len, size_t payload_len);
+    Record* record(uint64_t offset) const;
+    bool valid(uint64_t offset) const;
+    void dropFront();
+    void skipWrap();
+    void clear();
+    void trim();
+
+    int fd;
+    char* map;
+    size_t map_size;
+    Header* header;
+    // size of the ring of records
+    size_t area;
+    // offset of each record from first() to end(), and number of them removed
+    std::deque<uint64_t> offsets;
+    size_t removed;
+    uint64_t overwritten_count;
+};
+
+#endif
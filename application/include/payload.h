@@ -0,0 +1,106 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef PAYLOAD_H_INCLUDED
+#define PAYLOAD_H_INCLUDED
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "json_writer.h"
+
+// version of the binary telemetry schema, to be bumped on any incompatible change of its fields
+#define TELEMETRY_SCHEMA_VERSION 1
+
+// PayloadFormat selects how the MQTT telemetry messages are encoded
+enum PayloadFormat
+{
+    // the text JSON payload with string values
+    PAYLOAD_JSON,
+    // CBOR (RFC 7049) map of the telemetry schema
+    PAYLOAD_CBOR,
+    // MessagePack map of the telemetry schema
+    PAYLOAD_MSGPACK
+};
+
+// Telemetry is a part event or the current info of a stream as sent to MQTT
+struct Telemetry
+{
+    int stream;
+    // "new", "defect", "left" for part events, "info" for the current info
+    const char* event;
+    bool defect;
+    int area;
+    cv::Rect rect;
+    int total_parts;
+    int total_defects;
+    // milliseconds since the epoch
+    int64_t timestamp;
+};
+
+// encodeTelemetry encodes the telemetry in the binary format, replacing the content of out
+void encodeTelemetry(const Telemetry& t, PayloadFormat format, std::vector<uint8_t>& out);
+// writeTelemetry writes the JSON message of the telemetry: the stream and defect flag of the current
+// info, or every field of a part event
+void writeTelemetry(const Telemetry& t, JsonWriter& w);
+
+// TelemetryBatch collects the telemetry of a topic to send it as one message, once max_count messages
+// were collected or the oldest one is max_age old. Each batch carries a sequence number, so the
+// receiver can tell when batches were lost.
+class TelemetryBatch
+{
+public:
+    TelemetryBatch();
+
+    void configure(size_t max_count, std::chrono::milliseconds max_age);
+    // enabled is false when every message is sent on its own
+    bool enabled() const { return max_count > 1; }
+    bool empty() const { return items.empty(); }
+
+    // add collects the telemetry, it returns true if the batch is full
+    bool add(const Telemetry& t);
+    // due tells whether the oldest message is max_age old
+    bool due(std::chrono::steady_clock::time_point now) const;
+    // timeLeft returns the time until the batch is due, at most limit
+    std::chrono::milliseconds timeLeft(std::chrono::steady_clock::time_point now, std::chrono::milliseconds limit) const;
+    size_t size() const { return items.size(); }
+    uint64_t sequence() const { return seq; }
+
+    // encode writes the batch in the format to out, then starts the next batch. JSON batches are
+    // {"Seq": "n", "Messages": [...]} with the usual JSON messages, binary batches are a map of the
+    // schema version "v", the number "q" and the "m" array of telemetry maps without their version.
+    void encode(PayloadFormat format, std::string& out);
+
+private:
+    std::vector<Telemetry> items;
+    size_t max_count;
+    std::chrono::milliseconds max_age;
+    std::chrono::steady_clock::time_point first;
+    uint64_t seq;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef PREPROCESS_H_INCLUDED
+#define PREPROCESS_H_INCLUDED
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "buffer_pool.h"
+#include "stats.h"
+
+// preprocess turns a captured frame into the binary mask of the assembly parts:
+// gray -> 3x3 Gaussian blur -> OPEN -> CLOSE -> OPEN (3x3 ellipse) -> binary threshold.
+// The frame is either in color, gray, or a YUYV camera frame with the luma in its first channel.
+// The morphology uses the vectorized cross kernels of morphology.h. Each stage is timed when a timer is given,
+// the intermediate images are taken from the pool when one is given.
+void preprocess(const cv::Mat& frame, cv::Mat& mask, int thresh, StageClock* timer = nullptr, BufferPool* pool = nullptr);
+
+// preprocessReference runs the same chain with OpenCV functions only, to verify the optimized paths against
+void preprocessReference(const cv::Mat& frame, cv::Mat& mask, int thresh);
+
+// FusedPreprocessor computes the same mask as preprocessReference in a single pass over the frame.
+// Every stage keeps only the last three rows of its input: as soon as a row of gray pixels
+// is converted it is pushed through the blur, the six erode/dilate steps and the threshold,
+// so the intermediate data stays in a few kilobytes of cache instead of six full images.
+// A FusedPreprocessor must not be used by two threads at the same time.
+class FusedPreprocessor
+{
+public:
+    FusedPreprocessor();
+
+    void run(const cv::Mat& frame, cv::Mat& mask, int thresh);
+
+private:
+    uchar* line(int stage, int row);
+    void feed(int stage, int row);
+    void emit(int stage, int row);
+
+    std::vector<uchar> lines;
+    std::vector<ushort> sums;
+    cv::Mat* dst;
+    int width;
+    int height;
+    int thresh;
+};
+
+// number of rows above and below a band needed to compute its mask exactly:
+// one for the blur and one for each of the six erode/dilate steps
+#define PREPROCESS_HALO 7
+
+// BandedPreprocessor splits the frame into horizontal bands preprocessed in parallel on the OpenCV
+// thread pool, with preprocess or a FusedPreprocessor per band. Each band is computed from its rows
+// plus PREPROCESS_HALO rows on either side, so the seams are exact and the mask is identical to the
+// one of the whole frame. A BandedPreprocessor must not be used by two threads at the same time.
+class BandedPreprocessor
+{
+public:
+    void run(const cv::Mat& frame, cv::Mat& mask, int thresh, int bands, bool fused);
+
+private:
+    class Body;
+
+    std::vector<FusedPreprocessor> fusedPreprocessors;
+    std::vector<BufferPool> pools;
+    // the mask of each band with its halo
+    std::vector<cv::Mat> masks;
+};
+
+#endif
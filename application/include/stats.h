@@ -0,0 +1,117 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+#include <nlohmann/json.hpp>
+
+// Stage identifies a step of the frame processing pipeline
+enum Stage
+{
+    STAGE_CAPTURE,
+    STAGE_GRAY,
+    STAGE_BLUR,
+    STAGE_MORPHOLOGY,
+    STAGE_THRESHOLD,
+    STAGE_PREPROCESS,
+    STAGE_VERIFY,
+    STAGE_BLOBS,
+    STAGE_SELECT,
+    STAGE_FRAME,
+    STAGE_COUNT
+};
+
+const char* stageName(Stage stage);
+
+// LatencyHistogram records durations into log-linear buckets (8 per power of two,
+// so percentiles are within 12.5%) using relaxed atomics only, cheap enough to stay
+// enabled on every frame and safe to read while it is being updated.
+class LatencyHistogram
+{
+public:
+    static const int BUCKETS = 64 * 8;
+
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    void reset();
+
+    uint64_t count() const;
+    uint64_t max() const;
+    // percentile returns the upper bound in ns of the bucket holding the p-th percentile (0-100)
+    uint64_t percentile(double p) const;
+
+private:
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> total;
+    std::atomic<uint64_t> maximum;
+};
+
+// PipelineStats contains a latency histogram for each pipeline stage of a stream
+struct PipelineStats
+{
+    LatencyHistogram stages[STAGE_COUNT];
+
+    void reset();
+};
+
+// StageClock times consecutive pipeline stages, each lap records the time since the previous one
+class StageClock
+{
+public:
+    explicit StageClock(PipelineStats& stats)
+        : stats(stats), start(std::chrono::steady_clock::now()), last(start) {}
+
+    void lap(Stage stage)
+    {
+        auto now = std::chrono::steady_clock::now();
+        stats.stages[stage].record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+        last = now;
+    }
+
+    // total records the time since the clock was started
+    void total(Stage stage)
+    {
+        auto now = std::chrono::steady_clock::now();
+        stats.stages[stage].record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count());
+        last = now;
+    }
+
+private:
+    PipelineStats& stats;
+    std::chrono::steady_clock::time_point start;
+    std::chrono::steady_clock::time_point last;
+};
+
+// printStats writes a p50/p95/p99/max table in milliseconds of the stages that recorded samples
+void printStats(std::ostream& out, const PipelineStats& stats);
+// statsJson returns the same figures as printStats keyed by stage name
+nlohmann::json statsJson(const PipelineStats& stats);
+
+#endif
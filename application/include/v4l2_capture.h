@@ -0,0 +1,99 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef V4L2_CAPTURE_H_INCLUDED
+#define V4L2_CAPTURE_H_INCLUDED
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+// number of milliseconds grab waits for a frame, or for a buffer to capture it into
+#define V4L2_TIMEOUT_MS 5000
+
+// V4L2Capture reads a camera with V4L2 streaming I/O into kernel buffers mapped in memory. The camera
+// is set to GREY, or to YUYV when it has no GREY format, and retrieve wraps the buffer of a frame in a
+// Mat without copying it: a CV_8UC1 image for GREY, a CV_8UC2 image with the luma in its first channel
+// for YUYV. A buffer goes back to the driver once every Mat sharing it is released, so the frames can
+// be handed down the pipeline like any other, but the V4L2Capture must outlive them.
+// open, grab, retrieve and close are called by one thread, the frames may be released by any thread.
+class V4L2Capture
+{
+public:
+    V4L2Capture();
+    ~V4L2Capture();
+
+    // open starts streaming from /dev/video<index> into up to count buffers,
+    // it returns false if the device can not stream GREY or YUYV frames
+    bool open(int index, int count);
+    void close();
+    bool isOpened() const { return fd >= 0; }
+
+    // grab waits for the next frame, it returns false on error or when no frame came in time
+    bool grab();
+    // retrieve returns the frame grabbed last, it returns false if it was already retrieved
+    bool retrieve(cv::Mat& frame);
+
+    cv::Size size() const { return cv::Size(width, height); }
+    // frame rate reported by the driver, 0 if unknown
+    double fps() const { return frame_rate; }
+    // pixel format of the frames, GREY or YUYV
+    std::string format() const;
+
+private:
+    class Allocator;
+
+    struct Buffer
+    {
+        void* start;
+        size_t length;
+        // held is set while the frame of the buffer is in Mats
+        bool held;
+    };
+
+    bool queue(int index);
+    void release(int index);
+
+    int fd;
+    int width;
+    int height;
+    size_t stride;
+    unsigned pixel_format;
+    double frame_rate;
+    std::vector<Buffer> buffers;
+    std::unique_ptr<Allocator> allocator;
+    // index of the buffer grabbed and not retrieved yet, -1 if none
+    int current;
+
+    // guards the buffers queued to the driver, returned is notified when the pipeline releases one
+    std::mutex m;
+    std::condition_variable returned;
+    int queued;
+    bool streaming;
+};
+
+#endif
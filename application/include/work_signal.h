@@ -0,0 +1,57 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef WORK_SIGNAL_H_INCLUDED
+#define WORK_SIGNAL_H_INCLUDED
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// WorkSignal parks idle worker threads until new work is posted or the signal is shut down.
+// Workers take a ticket before looking for work and wait on it if they found none, so a post
+// that lands in between is never lost. Posting only touches the mutex when a worker is parked.
+class WorkSignal
+{
+public:
+    WorkSignal();
+
+    // post wakes up one parked worker, called after new work has been queued
+    void post();
+    // ticket returns the current post count to pass to wait
+    uint64_t ticket() const;
+    // wait blocks until something was posted after the ticket was taken, returns false on shutdown
+    bool wait(uint64_t ticket);
+    // shutdown wakes up all the parked workers and makes further waits return immediately
+    void shutdown();
+
+private:
+    std::mutex m;
+    std::condition_variable cv;
+    std::atomic<uint64_t> posted;
+    std::atomic<int> waiters;
+    std::atomic<bool> stopped;
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <opencv2/imgproc.hpp>
+
+#include "blobs.h"
+
+using namespace cv;
+
+static void findContourBlobs(const Mat& mask, BlobWorkspace& ws, std::vector<Blob>& blobs)
+{
+    // find the contours of assembly part
+    findContours(mask, ws.contours, ws.hierarchy, RETR_EXTERNAL, CHAIN_APPROX_NONE);
+
+    for (size_t i = 0; i < ws.contours.size(); i++) {
+        Blob blob;
+        blob.rect = boundingRect(ws.contours[i]);
+        blob.area = 0;
+        blobs.push_back(blob);
+    }
+}
+
+static void findComponentBlobs(const Mat& mask, BlobWorkspace& ws, std::vector<Blob>& blobs)
+{
+    int count = connectedComponentsWithStats(mask, ws.labels, ws.stats, ws.centroids, 8, CV_32S);
+
+    // label 0 is the background
+    for (int i = 1; i < count; i++) {
+        const int* stat = ws.stats.ptr<int>(i);
+        const double* centroid = ws.centroids.ptr<double>(i);
+
+        Blob blob;
+        blob.rect = Rect(stat[CC_STAT_LEFT], stat[CC_STAT_TOP], stat[CC_STAT_WIDTH], stat[CC_STAT_HEIGHT]);
+        blob.area = stat[CC_STAT_AREA];
+        blob.centroid = Point2d(centroid[0], centroid[1]);
+        blobs.push_back(blob);
+    }
+}
+
+void findBlobs(const Mat& mask, BlobMethod method, BlobWorkspace& ws, std::vector<Blob>& blobs)
+{
+    blobs.clear();
+
+    if (method == BLOBS_COMPONENTS) {
+        findComponentBlobs(mask, ws, blobs);
+    } else {
+        findContourBlobs(mask, ws, blobs);
+    }
+}
+
+// touchesEdge tells whether a foreground pixel of the mask within r lies on the edge
+static bool touchesEdge(const Mat& mask, const Mat& edge, const Rect& r)
+{
+    for (int y = r.y; y < r.y + r.height; y++) {
+        const uchar* m = mask.ptr<uchar>(y);
+        const uchar* e = edge.ptr<uchar>(y);
+        for (int x = r.x; x < r.x + r.width; x++) {
+            if (m[x] & e[x]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int selectPart(const std::vector<Blob>& blobs, const Mat& mask, const Mat& edge, bool bounded, Rect& rect)
+{
+    int max_blob_area = 0;
+
+    // we will pick detected objects with largest size
+    for (size_t i = 0; i < blobs.size(); i++)
+    {
+        const Rect& r = blobs[i].rect;
+        int part_area = r.width * r.height;
+        // is large enough, and completely within the camera with no overlapping edge.
+        if (part_area > max_blob_area && r.x > 0 && r.x + r.width < mask.cols && r.width > 30 &&
+            (!bounded || (r.y > 0 && r.y + r.height < mask.rows)) &&
+            (edge.empty() || !touchesEdge(mask, edge, r)))
+        {
+            max_blob_area = part_area;
+            rect = r;
+        }
+    }
+
+    return max_blob_area;
+}
@@ -0,0 +1,65 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "buffer_pool.h"
+
+std::atomic<uint64_t> BufferPool::allocated_count(0);
+std::atomic<uint64_t> BufferPool::reused_count(0);
+
+BufferPool::BufferPool()
+    : next(0)
+{
+}
+
+bool BufferPool::isFree(cv::Mat& m) const
+{
+    // the atomic read also orders the last reader's accesses before the data is overwritten
+    return m.u == nullptr || CV_XADD(&m.u->refcount, 0) == 1;
+}
+
+cv::Mat BufferPool::acquire(cv::Size size, int type)
+{
+    cv::Mat* spare = nullptr;
+    for (size_t i = 0; i < buffers.size(); i++) {
+        cv::Mat& m = buffers[(next + i) % buffers.size()];
+        if (!isFree(m)) {
+            continue;
+        }
+        if (m.size() == size && m.type() == type) {
+            next = (next + i + 1) % buffers.size();
+            reused_count.fetch_add(1, std::memory_order_relaxed);
+            return m;
+        }
+        if (spare == nullptr) {
+            spare = &m;
+        }
+    }
+
+    if (spare == nullptr) {
+        buffers.emplace_back();
+        spare = &buffers.back();
+    }
+    spare->create(size, type);
+    allocated_count.fetch_add(1, std::memory_order_relaxed);
+    return *spare;
+}
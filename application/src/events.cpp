@@ -0,0 +1,92 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+
+#include "events.h"
+
+const char* partEventName(PartEventType type)
+{
+    switch (type) {
+    case PART_NEW:
+        return "new";
+    case PART_DEFECT:
+        return "defect";
+    case PART_LEFT:
+        return "left";
+    }
+    return "unknown";
+}
+
+EventQueue::EventQueue()
+    : stopped(false)
+{
+}
+
+void EventQueue::push(const PartEvent& event)
+{
+    {
+        std::lock_guard<std::mutex> lock(m);
+        queue.push_back(event);
+    }
+    cv.notify_one();
+}
+
+bool EventQueue::wait(std::vector<PartEvent>& events, std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m);
+    cv.wait_for(lock, timeout, [this]{ return !queue.empty() || stopped; });
+    if (queue.empty() || stopped) {
+        return false;
+    }
+
+    events.insert(events.end(), queue.begin(), queue.end());
+    queue.clear();
+    return true;
+}
+
+void EventQueue::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(m);
+        stopped = true;
+    }
+    cv.notify_all();
+}
+
+void coalesceEvents(std::vector<PartEvent>& events)
+{
+    std::vector<PartEvent> latest;
+
+    // walk backwards so the first event seen of each stream and type is the latest one
+    for (auto it = events.rbegin(); it != events.rend(); ++it) {
+        bool seen = std::any_of(latest.begin(), latest.end(), [&](const PartEvent& e) {
+            return e.stream == it->stream && e.type == it->type;
+        });
+        if (!seen) {
+            latest.push_back(*it);
+        }
+    }
+
+    events.assign(latest.rbegin(), latest.rend());
+}
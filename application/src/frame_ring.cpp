@@ -0,0 +1,127 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <thread>
+
+#include "frame_ring.h"
+
+FrameRing::FrameRing(size_t capacity, Policy policy)
+    : slots(new Slot[capacity > 0 ? capacity : 1]),
+      n(capacity > 0 ? capacity : 1),
+      mode(policy),
+      closed(false),
+      head(0),
+      tail(0),
+      pushed_count(0),
+      dropped_count(0)
+{
+    for (size_t i = 0; i < n; i++) {
+        slots[i].seq.store(2 * i, std::memory_order_relaxed);
+    }
+}
+
+bool FrameRing::push(const cv::Mat& frame)
+{
+    uint64_t h = head.load(std::memory_order_relaxed);
+    Slot& slot = slots[h % n];
+
+    for (;;) {
+        // taken before looking at the slot, so a pop in between is not missed
+        uint64_t ticket = space.ticket();
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+        if (seq == 2 * h) {
+            break;
+        }
+
+        // the slot still holds position h - n, so the ring is full
+        if (mode == OVERWRITE_OLDEST && seq == 2 * (h - n) + 1) {
+            uint64_t t = h - n;
+            // the consumer claims positions the same way, so only one of us gets to drop it
+            if (tail.compare_exchange_strong(t, t + 1, std::memory_order_acq_rel)) {
+                slot.mat.release();
+                slot.seq.store(2 * h, std::memory_order_relaxed);
+                dropped_count.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        } else if (closed.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        if (mode == BLOCK) {
+            // sleep rather than spin, the consumers may need every core
+            space.wait(ticket);
+        } else {
+            // the consumer is copying the slot out
+            std::this_thread::yield();
+        }
+    }
+
+    slot.mat = frame;
+    slot.seq.store(2 * h + 1, std::memory_order_release);
+    head.store(h + 1, std::memory_order_release);
+    pushed_count.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool FrameRing::pop(cv::Mat& frame)
+{
+    uint64_t t = tail.load(std::memory_order_acquire);
+
+    for (;;) {
+        Slot& slot = slots[t % n];
+        uint64_t seq = slot.seq.load(std::memory_order_acquire);
+
+        if (seq != 2 * t + 1) {
+            uint64_t current = tail.load(std::memory_order_acquire);
+            if (current == t) {
+                return false;
+            }
+            // the producer dropped the position we were looking at
+            t = current;
+            continue;
+        }
+
+        if (tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel)) {
+            frame = slot.mat;
+            slot.mat.release();
+            slot.seq.store(2 * (t + n), std::memory_order_release);
+            if (mode == BLOCK) {
+                space.post();
+            }
+            return true;
+        }
+    }
+}
+
+void FrameRing::close()
+{
+    closed.store(true, std::memory_order_release);
+    space.shutdown();
+}
+
+size_t FrameRing::size() const
+{
+    uint64_t t = tail.load(std::memory_order_acquire);
+    uint64_t h = head.load(std::memory_order_acquire);
+    return h > t ? h - t : 0;
+}
@@ -0,0 +1,109 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <cstring>
+
+#include "json_writer.h"
+
+JsonWriter::JsonWriter()
+    : len(0), first(true), closed(false), overflow(false)
+{
+    append("{", 1);
+}
+
+JsonWriter& JsonWriter::field(const char* name, const char* value)
+{
+    key(name);
+    append("\"", 1);
+    appendString(value);
+    append("\"", 1);
+    return *this;
+}
+
+JsonWriter& JsonWriter::field(const char* name, long long value)
+{
+    char digits[24];
+    int n = 0;
+    // work on the magnitude as unsigned so the most negative value does not overflow
+    unsigned long long v = value < 0 ? 0ULL - (unsigned long long)value : (unsigned long long)value;
+
+    do {
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v != 0);
+    if (value < 0) {
+        digits[n++] = '-';
+    }
+
+    key(name);
+    append("\"", 1);
+    while (n > 0) {
+        append(&digits[--n], 1);
+    }
+    append("\"", 1);
+    return *this;
+}
+
+const char* JsonWriter::c_str()
+{
+    if (!closed) {
+        append("}", 1);
+        closed = true;
+    }
+    buf[len] = '\0';
+    return buf;
+}
+
+void JsonWriter::key(const char* name)
+{
+    if (!first) {
+        append(", ", 2);
+    }
+    first = false;
+
+    append("\"", 1);
+    appendString(name);
+    append("\": ", 3);
+}
+
+// appendString escapes the characters that would end the JSON string early
+void JsonWriter::appendString(const char* s)
+{
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            append("\\", 1);
+        }
+        append(s, 1);
+    }
+}
+
+void JsonWriter::append(const char* s, size_t n)
+{
+    // keep room for the closing brace and the terminating null
+    if (overflow || len + n + 2 > PAYLOAD_MAX) {
+        overflow = true;
+        return;
+    }
+    memcpy(buf + len, s, n);
+    len += n;
+}
@@ -25,7 +25,6 @@
 #include <iostream>
 #include <stdio.h>
 #include <thread>
-#include <queue>
 #include <map>
 #include <atomic>
 #include <csignal>
@@ -34,6 +33,8 @@
 #include <syslog.h>
 #include <string>
 #include <fstream>
+#include <memory>
+#include <vector>
 
 // OpenCV includes
 #include <opencv2/core.hpp>
@@ -45,6 +46,28 @@
 
 // MQTT
 #include "mqtt.h"
+#include "json_writer.h"
+#include "payload.h"
+
+// lock-free frame queue
+#include "frame_ring.h"
+#include "buffer_pool.h"
+#include "work_signal.h"
+
+// direct camera capture
+#include "v4l2_capture.h"
+
+// pipeline latency statistics
+#include "stats.h"
+
+// frame preprocessing
+#include "preprocess.h"
+
+// blob extraction
+#include "blobs.h"
+
+// part events
+#include "events.h"
 
 using namespace std;
 using namespace cv;
@@ -54,31 +77,83 @@ json jsonobj;
 
 
 // OpenCV-related variables
-Mat frame, displayFrame;
-VideoCapture cap;
+// frames are resized to frame_size before processing and display, unless native is set
+const Size frame_size(960, 540);
+bool native = false;
+// number of horizontal bands a frame is split into to preprocess it on several cores
+int bands = 1;
+// delay paces the capture of video files to their frame rate when they are displayed, ui_delay is the
+// number of milliseconds between two refreshes of the display windows
 int delay = 5;
-int rate;
-// nextImage provides queue for captured video frames
-queue<Mat> nextImage;
+int ui_delay = 0;
+// max_skip is the most frames in a row the capture may leave undecoded when the workers fall behind, 0 never skips
+int max_skip = 4;
+// v4l2 reads the cameras straight from V4L2 instead of through VideoCapture, when they support it
+bool v4l2 = true;
+atomic<int> rate(1);
+// headless skips all the display work and lets capture run as fast as the sources allow
+bool headless = false;
+// benchmark runs headless, processes every frame and prints throughput and latency figures at the end
+bool benchmark = false;
+// fused selects the single-pass preprocessing kernel, verify checks the preprocessing against the OpenCV chain
+bool fused = false;
+bool verify = false;
+// blob_method selects how the parts are extracted from the thresholded mask
+BlobMethod blob_method = BLOBS_CONTOURS;
 
 // flag to control background threads
 atomic<bool> keepRunning(true);
 
+// payload_format selects the encoding of the current info and part event messages
+PayloadFormat payload_format = PAYLOAD_JSON;
+// counterBatch groups the messages of the counter topic, when enabled with -batch
+TelemetryBatch counterBatch;
+
+// syslog priorities up to log_level are logged, per message logs are built only when LOG_INFO is enabled
+int log_level = LOG_INFO;
+
 // flag to handle UNIX signals
 static volatile sig_atomic_t sig_caught = 0;
+// flag set by SIGUSR1 to dump the pipeline latency statistics
+static volatile sig_atomic_t stats_requested = 0;
 
 // mqtt parameters
-const string topic = "defects/counter";
-
-// assembly part and defect areas
-int min_area;
-int max_area;
-int total_parts = 0;
-int total_defects = 0;
-bool prev_seen = false;
-bool prev_defect = false;
-int frame_defect_count = 0;
-int frame_ok_count = 0;
+const char topic[] = "defects/counter";
+const char stats_topic[] = "defects/stats";
+// number of seconds between pipeline statistics updates to MQTT server, 0 disables them
+int stats_rate = 0;
+// publish_events sends one message per part event instead of the current info every rate seconds.
+// heartbeat is the number of seconds without events after which the current info is sent anyway (0 = never),
+// coalesce the number of milliseconds during which events are merged into one per stream and event type.
+atomic<bool> publish_events(false);
+int heartbeat = 10;
+int coalesce = 0;
+
+// Region is a region of interest where parts are detected, the whole frame when rect is empty.
+// mask restricts it further to a polygon, it is empty for a rectangular region. edge is the
+// outline of the polygon, the pixels of mask next to a pixel outside of it.
+struct Region
+{
+    Rect rect;
+    Mat mask;
+    Mat edge;
+};
+
+// Settings are the detection parameters that can be changed at runtime on the control topic.
+// They are replaced as a whole, so a frame is processed with one consistent set of them.
+struct Settings
+{
+    // assembly part and defect areas
+    int min_area;
+    int max_area;
+    // gray level above which a pixel belongs to an assembly part
+    int threshold;
+    // region of interest of each stream, by stream id
+    vector<Region> roi;
+};
+
+shared_ptr<const Settings> settings;
+mutex settings_m;
 
 // AssemblyInfo contains information about assembly line defects
 struct AssemblyInfo
@@ -90,204 +165,575 @@ struct AssemblyInfo
     Rect rect;
 };
 
-// currentInfo contains the latest AssemblyInfo as tracked by the application
-AssemblyInfo currentInfo = {false};
+// Detection is what the stateless stages found in a frame, waiting for its turn in the part tracking
+struct Detection
+{
+    bool ready;
+    int part_area;
+    Rect max_rect;
+    // the part area is outside of the expected range
+    bool defect;
+    // the frame itself when it is to be displayed
+    Mat frame;
+};
+
+// number of frames of a stream taken by the workers and not tracked yet, each of them may hold its frame.
+// Twice the number of workers lets every worker take a new frame while one slow frame holds up the
+// tracking, without keeping dozens of finished frames alive.
+uint64_t reorder_window = 2;
+
+// Stream contains the capture and part tracking state for one entry of the config.json "inputs"
+struct Stream
+{
+    Stream(int id, const string& input, size_t queue_size, FrameRing::Policy policy)
+        : id(id), input(input), nextImage(queue_size, policy), detections(reorder_window) {}
+
+    int id;
+    string input;
+    VideoCapture cap;
+    // camera reads a camera input when it is open, cap is used otherwise. It must outlive the frames
+    // it captured, so it is declared before every member holding frames.
+    V4L2Capture camera;
+    // size of the processed frames
+    Size size;
+    // frame is the decoded frame before resizing, only used by the capture loop. The processed
+    // frames live in pool buffers shared by the ring, the workers and the display.
+    Mat frame;
+    BufferPool pool;
+    bool finished = false;
 
-mutex m, m1, m2;
+    // the latest processed frame to display and the info tracked for it, guarded by display_m
+    mutex display_m;
+    Mat shown;
+    AssemblyInfo shownInfo;
+
+    // nextImage provides queue for captured video frames
+    FrameRing nextImage;
+
+    // the capture leaves skip frames undecoded for each one it decodes, skipping counts them down,
+    // skipped counts every frame left undecoded. Only the capture thread touches them.
+    int skip = 0;
+    int skipping = 0;
+    uint64_t skipped = 0;
+
+    // frames are taken from nextImage under pop_m and numbered in capture order, taken is the number
+    // of frames taken so far
+    mutex pop_m;
+    uint64_t taken = 0;
+
+    // several workers process frames of the stream at once, their detections wait in a window indexed
+    // by frame number until every earlier frame went through the part tracking. tracked is the number
+    // of frames tracked so far, both are guarded by track_m.
+    mutex track_m;
+    vector<Detection> detections;
+    atomic<uint64_t> tracked{0};
+
+    // currentInfo contains the latest AssemblyInfo as tracked for this stream, guarded by m2
+    AssemblyInfo currentInfo = {false, false, 0, false, Rect()};
+    int total_parts = 0;
+    int total_defects = 0;
+    mutex m2;
+
+    // part tracking state, only touched by the worker holding track_m
+    bool prev_seen = false;
+    // prev_seen for the capture thread, which does not skip frames while a part is in view
+    atomic<bool> part_in_view{false};
+    bool prev_defect = false;
+    int frame_defect_count = 0;
+    int frame_ok_count = 0;
+
+    // latency of each pipeline stage
+    PipelineStats stats;
+
+    // number of frames where the preprocessing did not match the OpenCV chain
+    atomic<uint64_t> verified_frames{0};
+    atomic<uint64_t> mismatched_frames{0};
+};
+
+// Workspace holds the buffers a worker thread reuses from one frame to the next
+struct Workspace
+{
+    FusedPreprocessor fusedPreprocessor;
+    BandedPreprocessor bandedPreprocessor;
+    // the mask and the preprocessing temporaries
+    BufferPool pool;
+    // blobs found in the last frame and the buffers used to find them
+    vector<Blob> blobs;
+    BlobWorkspace blobWorkspace;
+};
+
+// streams contains every video input listed in the config file
+vector<unique_ptr<Stream>> streams;
+
+// frameSignal wakes up idle worker threads when a frame is queued on any stream
+WorkSignal frameSignal;
+
+// partEvents carries the part events from the workers to the MQTT thread
+EventQueue partEvents;
 
 const char* keys =
     "{ help h      | | Print help message. }"
     "{ minarea min | 20000 | Minimum part area of assembly object. }"
     "{ maxarea max | 30000 | Maximum part area of assembly object. }"
-    "{ rate r      | 1 | number of seconds between data updates to MQTT server. }";
+    "{ threshold   | 200 | gray level above which a pixel belongs to an assembly part. }"
+    "{ rate r      | 1 | number of seconds between data updates to MQTT server. }"
+    "{ workers w   | 0 | number of frame processing threads shared by all streams (0 = one per core). }"
+    "{ queue q     | 1 | number of captured frames buffered per input. }"
+    "{ block b     | | wait for a free queue slot instead of dropping the oldest frame when the queue is full. }"
+    "{ maxskip     | 4 | most frames in a row left undecoded while processing falls behind (0 = decode every frame). }"
+    "{ headless    | | run without a display window, stop on SIGTERM only. }"
+    "{ uifps       | 0 | refresh rate of the display windows, in frames per second (0 = frame rate of the inputs). }"
+    "{ benchmark   | | process every frame of the inputs as fast as possible, then print throughput and latency. }"
+    "{ statsrate   | 0 | number of seconds between pipeline latency updates to MQTT server (0 = never). }"
+    "{ fused       | | use the single-pass fused preprocessing kernel. }"
+    "{ verify      | | also run the OpenCV preprocessing chain on every frame and report any difference. }"
+    "{ native      | | process the frames at the capture resolution instead of resizing them to 960x540. }"
+    "{ capture     | v4l2 | camera capture: v4l2 (luma straight from V4L2 buffers, VideoCapture if unsupported) or opencv (VideoCapture). }"
+    "{ bands       | 1 | number of horizontal bands each frame is split into to preprocess it on several cores. }"
+    "{ blobs       | contours | blob extraction method: contours (findContours) or components (connected components). }"
+    "{ publish p   | poll | MQTT publishing: poll (current info every rate seconds) or events (one message per part event). }"
+    "{ heartbeat   | 10 | number of seconds without events after which the current info is published (0 = never). }"
+    "{ coalesce    | 0 | number of milliseconds during which part events are merged before publishing. }"
+    "{ format      | json | MQTT payload encoding: json, cbor or msgpack. }"
+    "{ batch       | 1 | number of current info or part event messages sent together as one MQTT message. }"
+    "{ batchms     | 1000 | maximum number of milliseconds a message waits for its batch to fill up. }"
+    "{ outbox      | | file keeping the MQTT messages published while the broker is unreachable. }"
+    "{ outboxsize  | 4096 | size of the outbox in kilobytes, the oldest messages are overwritten when it is full. }"
+    "{ drainrate   | 50 | number of messages per second sent from the outbox once the broker is reachable. }"
+    "{ loglevel    | 6 | highest syslog priority logged, 6 (info) logs every MQTT message, 5 (notice) or lower does not. }";
+
+// getSettings returns the current settings, they stay valid for as long as the caller holds them
+shared_ptr<const Settings> getSettings() {
+    lock_guard<mutex> lock(settings_m);
+    return settings;
+}
 
-// nextImageAvailable returns the next image from the queue in a thread-safe way
-Mat nextImageAvailable() {
+// setSettings replaces the settings, frames being processed finish with the previous ones
+void setSettings(shared_ptr<const Settings> next) {
+    lock_guard<mutex> lock(settings_m);
+    settings = next;
+}
+
+// nextImageAvailable returns the next image from the stream queue, or an empty Mat if there is none
+Mat nextImageAvailable(Stream& s) {
     Mat rtn;
-    m.lock();
-    if (!nextImage.empty()) {
-        rtn = nextImage.front();
-        nextImage.pop();
-    }
-    m.unlock();
+    s.nextImage.pop(rtn);
 
     return rtn;
 }
 
-// addImage adds an image to the queue in a thread-safe way
-void addImage(Mat img) {
-    m.lock();
-    if (nextImage.empty()) {
-        nextImage.push(img);
+// addImage adds an image to the stream queue, dropping the oldest queued image or waiting for space when full
+void addImage(Stream& s, Mat img) {
+    if (s.nextImage.push(img)) {
+        frameSignal.post();
     }
-    m.unlock();
 }
 
-// getCurrentInfo returns the most-recent AssemblyInfo for the application.
-AssemblyInfo getCurrentInfo() {
-    m2.lock();
+// getCurrentInfo returns the most-recent AssemblyInfo for the stream.
+AssemblyInfo getCurrentInfo(Stream& s) {
+    s.m2.lock();
     AssemblyInfo info;
-    info = currentInfo;
-    m2.unlock();
+    info = s.currentInfo;
+    s.m2.unlock();
 
     return info;
 }
 
-// updateInfo uppdates the current AssemblyInfo for the application to the latest detected values
-void updateInfo(AssemblyInfo info) {
-    m2.lock();
-    currentInfo.defect = info.defect;
-    currentInfo.show = info.show;
-    currentInfo.area = info.area;
-    currentInfo.rect = info.rect;
+// getTotals returns the part and defect counters for the stream.
+void getTotals(Stream& s, int& parts, int& defects) {
+    s.m2.lock();
+    parts = s.total_parts;
+    defects = s.total_defects;
+    s.m2.unlock();
+}
+
+// updateInfo uppdates the current AssemblyInfo for the stream to the latest detected values
+void updateInfo(Stream& s, AssemblyInfo info) {
+    s.m2.lock();
+    s.currentInfo.defect = info.defect;
+    s.currentInfo.show = info.show;
+    s.currentInfo.area = info.area;
+    s.currentInfo.rect = info.rect;
     if (info.inc_total) {
-        total_parts++;
+        s.total_parts++;
     }
     if (info.defect) {
-        total_defects++;
+        s.total_defects++;
     }
-    m2.unlock();
+    s.m2.unlock();
 }
 
-// resetInfo resets the current AssemblyInfo for the application.
-void resetInfo() {
-    m2.lock();
-    currentInfo.defect = false;
-    currentInfo.area = 0;
-    currentInfo.inc_total = false;
-    currentInfo.rect = Rect(0,0,0,0);
-    m2.unlock();
+// resetInfo resets the current AssemblyInfo for the stream.
+void resetInfo(Stream& s) {
+    s.m2.lock();
+    s.currentInfo.defect = false;
+    s.currentInfo.area = 0;
+    s.currentInfo.inc_total = false;
+    s.currentInfo.rect = Rect(0,0,0,0);
+    s.m2.unlock();
 }
 
-// publish MQTT message with a JSON payload
-void publishMQTTMessage(const string& topic, const AssemblyInfo& info)
+// nowMillis returns the number of milliseconds since the epoch
+int64_t nowMillis() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// publish the pipeline latency statistics of every stream to MQTT
+void publishMQTTStats(const char* topic)
 {
-    ostringstream s;
-    s << "{\"Defect\": \"" << info.defect << "\"}";
-    string payload = s.str();
+    json payload = json::array();
+    for (auto& s : streams) {
+        payload.push_back({{"Stream", s->id}, {"Stages", statsJson(s->stats)}});
+    }
 
-    mqtt_publish(topic, payload);
+    mqtt_publish(topic, payload.dump());
 
-    string msg = "MQTT message published to topic: " + topic;
-    syslog(LOG_INFO, "%s", msg.c_str());
-    syslog(LOG_INFO, "%s", payload.c_str());
+    if (log_level >= LOG_INFO) {
+        syslog(LOG_INFO, "MQTT stats published to topic: %s", topic);
+    }
 }
 
-// message handler for the MQTT subscription for the any desired control channel topic
-int handleMQTTControlMessages(void *context, char *topicName, int topicLen, MQTTClient_message *message)
+// buffer of the binary and batch payloads, only used by the MQTT message thread
+vector<uint8_t> binary_payload;
+string batch_payload;
+
+// publish MQTT message with the telemetry in the payload format
+void publishMQTTTelemetry(const char* topic, const Telemetry& t)
 {
-    string topic = topicName;
-    string msg = "MQTT message received: " + topic;
-    syslog(LOG_INFO, "%s", msg.c_str());
+    if (payload_format == PAYLOAD_JSON) {
+        JsonWriter payload;
+        writeTelemetry(t, payload);
 
-    return 1;
+        const char* msg = payload.c_str();
+        if (!payload.ok()) {
+            syslog(LOG_ERR, "MQTT %s payload too large, not published", t.event);
+            return;
+        }
+
+        mqtt_publish(topic, msg, payload.size());
+
+        if (log_level >= LOG_INFO) {
+            syslog(LOG_INFO, "MQTT %s message published to topic: %s", t.event, topic);
+            syslog(LOG_INFO, "%s", msg);
+        }
+        return;
+    }
+
+    encodeTelemetry(t, payload_format, binary_payload);
+
+    mqtt_publish(topic, (const char*)binary_payload.data(), binary_payload.size());
+
+    if (log_level >= LOG_INFO) {
+        syslog(LOG_INFO, "MQTT %s telemetry of %zu bytes published to topic: %s", t.event, binary_payload.size(), topic);
+    }
+}
+
+// publish the batch of telemetry collected for the topic as one MQTT message
+void publishMQTTBatch(const char* topic, TelemetryBatch& batch)
+{
+    if (batch.empty()) {
+        return;
+    }
+
+    size_t count = batch.size();
+    uint64_t seq = batch.sequence();
+    batch.encode(payload_format, batch_payload);
+
+    mqtt_publish(topic, batch_payload.data(), batch_payload.size());
+
+    if (log_level >= LOG_INFO) {
+        syslog(LOG_INFO, "MQTT batch %llu of %zu messages published to topic: %s", (unsigned long long)seq, count, topic);
+    }
+}
+
+// publishTelemetry publishes the telemetry on the counter topic, or adds it to the batch of the topic
+void publishTelemetry(const Telemetry& t)
+{
+    if (!counterBatch.enabled()) {
+        publishMQTTTelemetry(topic, t);
+    } else if (counterBatch.add(t)) {
+        publishMQTTBatch(topic, counterBatch);
+    }
+}
+
+// trackPart advances the part tracking state of the stream with the detection of its next frame,
+// it returns the info tracked for the frame
+AssemblyInfo trackPart(Stream& s, const Detection& d) {
+    int part_area = d.part_area;
+    Rect max_rect = d.max_rect;
+    bool defect = false;
+    bool frame_defect = false;
+    bool inc_total = false;
+    bool left = false;
+
+    // if no object is detected we dont do anything
+    if (part_area != 0) {
+        // increment ok or defect counts
+        if (d.defect)
+        {
+            frame_defect = true;
+            s.frame_defect_count++;
+        } else {
+            s.frame_ok_count++;
+        }
+
+        // if the part wasn't seen before it's a new part
+        if (!s.prev_seen) {
+            s.prev_seen = true;
+            inc_total = true;
+        } else {
+            // if the previously seen object has no defect detected in 10 previous consecutive frames
+            if (!frame_defect && s.frame_ok_count > 10) {
+                s.frame_defect_count = 0;
+            }
+            // if previously seen object has a defect detected in 10 previous consecutive frames
+            if (frame_defect && s.frame_defect_count > 10) {
+                if (!s.prev_defect) {
+                    s.prev_defect = true;
+                    defect = true;
+                }
+                s.frame_ok_count = 0;
+            }
+        }
+    } else {
+        left = s.prev_seen;
+        // no part detected -- we are looking at empty belt. reset values.
+        s.prev_seen = false;
+        s.prev_defect = false;
+        s.frame_defect_count = 0;
+        s.frame_ok_count = 0;
+    }
+    s.part_in_view = s.prev_seen;
+
+    AssemblyInfo info;
+    info.defect = defect;
+    info.show = s.prev_defect;
+    info.area = part_area;
+    info.rect = max_rect;
+    info.inc_total = inc_total;
+
+    updateInfo(s, info);
+
+    if (publish_events && (inc_total || defect || left)) {
+        PartEvent event;
+        event.stream = s.id;
+        event.area = part_area;
+        event.rect = max_rect;
+        getTotals(s, event.total_parts, event.total_defects);
+        event.timestamp = nowMillis();
+
+        if (left) {
+            event.type = PART_LEFT;
+            partEvents.push(event);
+        }
+        if (inc_total) {
+            event.type = PART_NEW;
+            partEvents.push(event);
+        }
+        if (defect) {
+            event.type = PART_DEFECT;
+            partEvents.push(event);
+        }
+    }
+    return info;
 }
 
-// Function called by worker thread to process the next available video frame.
+// trackFrame queues the detection of frame number seq, then runs the part tracking on every
+// detection that is next in frame order
+void trackFrame(Stream& s, uint64_t seq, const Detection& d) {
+    lock_guard<mutex> lock(s.track_m);
+    s.detections[seq % reorder_window] = d;
+
+    for (;;) {
+        Detection& next = s.detections[s.tracked % reorder_window];
+        if (!next.ready) {
+            break;
+        }
+        next.ready = false;
+        AssemblyInfo info = trackPart(s, next);
+        s.tracked++;
+
+        // the workers are done with the frame, it belongs to the display from now on
+        if (!next.frame.empty()) {
+            lock_guard<mutex> display(s.display_m);
+            s.shown = next.frame;
+            s.shownInfo = info;
+            next.frame.release();
+        }
+    }
+}
+
+// processFrame runs the detection pipeline on frame number seq of the stream, then hands the
+// detection to the part tracking.
+void processFrame(Stream& s, const Mat& next, uint64_t seq, Workspace& ws) {
+    StageClock timer(s.stats);
+    shared_ptr<const Settings> conf = getSettings();
+    const Region& roi = conf->roi[s.id];
+    Rect max_rect;
+    int part_area = 0;
+
+    // only the region of interest is processed, the blobs are mapped back to frame coordinates afterwards
+    Rect frame_rect(0, 0, next.cols, next.rows);
+    Rect area = roi.rect.empty() ? frame_rect : roi.rect & frame_rect;
+    Mat region = next(area);
+    Mat img = ws.pool.acquire(area.size(), CV_8UC1);
+
+    // gray, blur, morphology and threshold the frame into the mask of the assembly parts
+    if (bands > 1) {
+        ws.bandedPreprocessor.run(region, img, conf->threshold, bands, fused);
+        timer.lap(STAGE_PREPROCESS);
+    } else if (fused) {
+        ws.fusedPreprocessor.run(region, img, conf->threshold);
+        timer.lap(STAGE_PREPROCESS);
+    } else {
+        preprocess(region, img, conf->threshold, &timer, &ws.pool);
+    }
+
+    if (verify) {
+        Mat expected;
+        preprocessReference(region, expected, conf->threshold);
+        int diff = countNonZero(img != expected);
+        s.verified_frames++;
+        if (diff != 0) {
+            s.mismatched_frames++;
+            syslog(LOG_WARNING, "Preprocessing mismatch on input %d: %d pixels differ", s.id, diff);
+        }
+        timer.lap(STAGE_VERIFY);
+    }
+
+    // clear whatever lies outside of a polygonal region
+    Mat edge;
+    if (!roi.mask.empty()) {
+        Rect inner(area.x - roi.rect.x, area.y - roi.rect.y, area.width, area.height);
+        bitwise_and(img, roi.mask(inner), img);
+        edge = roi.edge(inner);
+    }
+
+    // find the blobs of assembly part
+    findBlobs(img, blob_method, ws.blobWorkspace, ws.blobs);
+    timer.lap(STAGE_BLOBS);
+
+    // we will pick detected objects with largest size, completely within the region
+    part_area = selectPart(ws.blobs, img, edge, !roi.rect.empty(), max_rect);
+    if (part_area != 0) {
+        max_rect.x += area.x;
+        max_rect.y += area.y;
+    }
+    timer.lap(STAGE_SELECT);
+
+    Detection d = {true, part_area, max_rect, part_area > conf->max_area || part_area < conf->min_area,
+                   headless ? Mat() : next};
+    trackFrame(s, seq, d);
+    timer.total(STAGE_FRAME);
+}
+
+// Function called by the pool of worker threads to process the next available video frames.
+// Workers process frames of the same stream concurrently, the part tracking puts their detections
+// back in frame order. Workers that find no frame on any stream sleep until addImage signals a new one.
 void frameRunner() {
+    Workspace ws;
+
     while (keepRunning.load()) {
-        Mat next = nextImageAvailable();
-        if (!next.empty()) {
-            Mat img;
-            Rect max_rect;
-            int max_blob_area = 0;
-            int part_area = 0;
-            bool defect = false;
-            bool frame_defect = false;
-            bool inc_total = false;
-            Size size(3,3);
-            vector<Vec4i> hierarchy;
-            vector<vector<Point> > contours;
-
-            cvtColor(frame, img, COLOR_RGB2GRAY);
-            // Blur the image to smooth it before easier preprocessing
-            GaussianBlur(img, img, size, 0, 0 );
-
-            // Morphology: OPEN -> CLOSE -> OPEN
-            // MORPH_OPEN removes the noise and closes the "holes" in the background
-            // MORPH_CLOSE remove the noise and closes the "holes" in the foreground
-            morphologyEx(img, img, MORPH_OPEN, getStructuringElement(MORPH_ELLIPSE, size));
-            morphologyEx(img, img, MORPH_CLOSE, getStructuringElement(MORPH_ELLIPSE, size));
-            morphologyEx(img, img, MORPH_OPEN, getStructuringElement(MORPH_ELLIPSE, size));
-
-            // threshold the image to emphasize assembly part
-            threshold(img, img, 200, 255, THRESH_BINARY);
-            // find the contours of assembly part
-            findContours(img, contours, hierarchy, RETR_EXTERNAL, CHAIN_APPROX_NONE);
-
-            // we will pick detected objects with largest size
-            for (size_t i = 0; i < contours.size(); i++)
+        uint64_t ticket = frameSignal.ticket();
+        bool processed = false;
+
+        for (auto& s : streams) {
+            Mat next;
+            uint64_t seq;
             {
-                Rect rect = boundingRect(contours[i]);
-                part_area = rect.width * rect.height;
-                // is large enough, and completely within the camera with no overlapping edge.
-                if (part_area > max_blob_area && rect.x > 0 && rect.x + rect.width < img.cols && rect.width > 30)
-                {
-                    max_blob_area = part_area;
-                    max_rect = rect;
-                }
-            }
-            part_area = max_blob_area;
-
-            // if no object is detected we dont do anything
-            if (part_area != 0) {
-                // increment ok or defect counts
-                if (part_area > max_area || part_area < min_area)
-                {
-                    frame_defect = true;
-                    frame_defect_count++;
-                } else {
-                    frame_ok_count++;
+                lock_guard<mutex> lock(s->pop_m);
+                // leave the frame queued while the frames before it hold up the reorder window
+                if (s->taken - s->tracked.load() >= reorder_window) {
+                    continue;
                 }
-
-                // if the part wasn't seen before it's a new part
-                if (!prev_seen) {
-                    prev_seen = true;
-                    inc_total = true;
-                } else {
-                    // if the previously seen object has no defect detected in 10 previous consecutive frames
-                    if (!frame_defect && frame_ok_count > 10) {
-                        frame_defect_count = 0;
-                    }
-                    // if previously seen object has a defect detected in 10 previous consecutive frames
-                    if (frame_defect && frame_defect_count > 10) {
-                        if (!prev_defect) {
-                            prev_defect = true;
-                            defect = true;
-                        }
-                        frame_ok_count = 0;
-                    }
+                next = nextImageAvailable(*s);
+                if (next.empty()) {
+                    continue;
                 }
-            } else {
-                // no part detected -- we are looking at empty belt. reset values.
-                prev_seen = false;
-                prev_defect = false;
-                frame_defect_count = 0;
-                frame_ok_count = 0;
+                seq = s->taken++;
             }
 
-            AssemblyInfo info;
-            info.defect = defect;
-            info.show = prev_defect;
-            info.area = part_area;
-            info.rect = max_rect;
-            info.inc_total = inc_total;
+            processFrame(*s, next, seq, ws);
+            processed = true;
+        }
 
-            updateInfo(info);
+        if (!processed) {
+            frameSignal.wait(ticket);
         }
     }
 
     cout << "Video processing thread stopped" << endl;
 }
 
-// Function called by worker thread to handle MQTT updates. Pauses for rate second(s) between updates.
+// publishCurrentInfo publishes the current info of every stream
+void publishCurrentInfo() {
+    for (auto& s : streams) {
+        AssemblyInfo info = getCurrentInfo(*s);
+        Telemetry t = {s->id, "info", info.defect, info.area, info.rect, 0, 0, nowMillis()};
+        getTotals(*s, t.total_parts, t.total_defects);
+        publishTelemetry(t);
+    }
+}
+
+// publishEvents waits up to timeout for part events and publishes them, returns false if there were none
+bool publishEvents(vector<PartEvent>& events, chrono::milliseconds timeout) {
+    events.clear();
+    if (!partEvents.wait(events, timeout)) {
+        return false;
+    }
+
+    if (coalesce > 0) {
+        // collect the events arriving during the coalescing window, then merge them
+        auto deadline = chrono::steady_clock::now() + chrono::milliseconds(coalesce);
+        while (chrono::steady_clock::now() < deadline &&
+               partEvents.wait(events, chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()))) {
+        }
+        coalesceEvents(events);
+    }
+
+    for (auto& event : events) {
+        Telemetry t = {event.stream, partEventName(event.type), event.type == PART_DEFECT, event.area,
+                       event.rect, event.total_parts, event.total_defects, event.timestamp};
+        publishTelemetry(t);
+    }
+    return true;
+}
+
+// Function called by worker thread to handle MQTT updates. Pauses for rate second(s) between updates,
+// or publishes the part events as they come with a heartbeat of the current info when there are none.
 void messageRunner() {
+    auto last_stats = chrono::steady_clock::now();
+    auto last_message = chrono::steady_clock::now();
+    vector<PartEvent> events;
+
     while (keepRunning.load()) {
-        AssemblyInfo info = getCurrentInfo();
-        publishMQTTMessage(topic, info);
-        this_thread::sleep_for(chrono::seconds(rate));
+        if (publish_events) {
+            // do not wait for events past the time the pending batch is due
+            auto timeout = counterBatch.timeLeft(chrono::steady_clock::now(), chrono::seconds(1));
+            if (publishEvents(events, timeout)) {
+                last_message = chrono::steady_clock::now();
+            } else if (heartbeat > 0 && chrono::steady_clock::now() - last_message >= chrono::seconds(heartbeat)) {
+                publishCurrentInfo();
+                last_message = chrono::steady_clock::now();
+            }
+        } else {
+            publishCurrentInfo();
+            this_thread::sleep_for(chrono::seconds(rate.load()));
+        }
+
+        if (counterBatch.due(chrono::steady_clock::now())) {
+            publishMQTTBatch(topic, counterBatch);
+        }
+
+        if (stats_rate > 0 && chrono::steady_clock::now() - last_stats >= chrono::seconds(stats_rate)) {
+            publishMQTTStats(stats_topic);
+            last_stats = chrono::steady_clock::now();
+        }
     }
 
+    // send what is left rather than losing it
+    publishMQTTBatch(topic, counterBatch);
+
     cout << "MQTT sender thread stopped" << endl;
 }
 
@@ -301,11 +747,446 @@ void handle_sigterm(int signum)
     }
 }
 
+// signal handler asking the main thread to dump the pipeline statistics
+void handle_sigusr1(int signum)
+{
+    stats_requested = 1;
+}
+
+// printMQTTStats prints what happened to the MQTT messages published so far
+void printMQTTStats()
+{
+    mqtt_stats stats = mqtt_get_stats();
+    cout << "MQTT " << mqtt_state_name(stats.state) << ": " << stats.reconnects << " reconnects, "
+         << stats.connect_failures << " failed connection attempts" << endl;
+    cout << "MQTT: " << stats.queued << " queued, " << stats.published << " published, "
+         << stats.delivered << " delivered, " << stats.failed << " failed, " << stats.dropped << " dropped, "
+         << stats.inflight << " in flight, " << stats.queue_depth << " waiting" << endl;
+    if (stats.stored > 0 || stats.outbox_depth > 0) {
+        cout << "MQTT outbox: " << stats.stored << " stored, " << stats.drained << " sent, "
+             << stats.overwritten << " overwritten, " << stats.oversize << " too large, "
+             << stats.outbox_depth << " waiting" << endl;
+    }
+}
+
+// printBufferStats prints how many image buffers were allocated, once the pools are warmed up
+// the count stays the same and every frame reuses buffers
+void printBufferStats()
+{
+    cout << "Buffers: " << BufferPool::allocated() << " allocated, " << BufferPool::reused() << " reused" << endl;
+}
+
+// dumpStats prints the pipeline latency statistics of every stream
+void dumpStats()
+{
+    for (auto& s : streams) {
+        cout << "Input " << s->id << ": " << s->input << endl;
+        printStats(cout, s->stats);
+    }
+    printBufferStats();
+    printMQTTStats();
+}
+
+// openStream opens the video source of the stream, which is either a file path or a camera ID.
+// Cameras are read with V4L2 into up to buffers frames when possible, with VideoCapture otherwise.
+bool openStream(Stream& s, int buffers)
+{
+    if (s.input.size() == 1 && *(s.input.c_str()) >= '0' && *(s.input.c_str()) <= '9') {
+        if (v4l2 && s.camera.open(std::stoi(s.input), buffers)) {
+            syslog(LOG_INFO, "Input %d: V4L2 capture %dx%d %s", s.id, s.camera.size().width,
+                   s.camera.size().height, s.camera.format().c_str());
+            return true;
+        }
+        s.cap.open(std::stoi(s.input));
+    } else {
+        s.cap.open(s.input);
+    }
+
+    return s.cap.isOpened();
+}
+
+// grabFrame grabs the next frame of the stream without decoding it
+bool grabFrame(Stream& s)
+{
+    return s.camera.isOpened() ? s.camera.grab() : s.cap.grab();
+}
+
+// retrieveFrame decodes the frame last grabbed into a buffer none of the previous frames still use, resized
+// to frame_size unless native is set. The luma of V4L2 frames is handed over in the kernel buffer itself
+// when it is not resized.
+bool retrieveFrame(Stream& s, Mat& frame)
+{
+    if (s.camera.isOpened()) {
+        Mat luma;
+        if (!s.camera.retrieve(luma)) {
+            return false;
+        }
+        if (native) {
+            frame = luma;
+        } else {
+            // a YUYV frame is resized as two channels, only the luma of the first one is used afterwards
+            frame = s.pool.acquire(frame_size, luma.type());
+            resize(luma, frame, frame_size);
+        }
+        return true;
+    }
+
+    frame = s.pool.acquire(native ? s.size : frame_size, CV_8UC3);
+    Mat& decoded = native ? frame : s.frame;
+    if (!s.cap.retrieve(decoded) || decoded.empty()) {
+        return false;
+    }
+    if (!native) {
+        resize(s.frame, frame, frame_size);
+    }
+    return true;
+}
+
+// parseRoi reads the optional region of interest of an input, either a rectangle
+// {"x": 0, "y": 150, "width": 960, "height": 250} or a polygon {"polygon": [[x, y], ...]},
+// in the coordinates of the processed frame of the given size
+bool parseRoi(const json& conf, Region& roi, Size size)
+{
+    try {
+        if (conf.count("polygon")) {
+            vector<Point> polygon;
+            for (auto& p : conf["polygon"]) {
+                polygon.push_back(Point(p.at(0).get<int>(), p.at(1).get<int>()));
+            }
+            if (polygon.size() < 3) {
+                return false;
+            }
+
+            roi.rect = boundingRect(polygon);
+            roi.mask = Mat::zeros(roi.rect.height, roi.rect.width, CV_8UC1);
+            for (auto& p : polygon) {
+                p.x -= roi.rect.x;
+                p.y -= roi.rect.y;
+            }
+            vector<vector<Point> > polygons(1, polygon);
+            fillPoly(roi.mask, polygons, Scalar(255));
+        } else {
+            roi.rect = Rect(conf.at("x").get<int>(), conf.at("y").get<int>(),
+                            conf.at("width").get<int>(), conf.at("height").get<int>());
+        }
+    } catch (const json::exception&) {
+        return false;
+    }
+
+    // the region must overlap the frame
+    Rect requested = roi.rect;
+    roi.rect &= Rect(Point(0, 0), size);
+    if (roi.rect.empty()) {
+        return false;
+    }
+    if (!roi.mask.empty()) {
+        roi.mask = roi.mask(Rect(roi.rect.x - requested.x, roi.rect.y - requested.y, roi.rect.width, roi.rect.height));
+
+        // the outline is what an erosion removes, the bounding rectangle counts as outside
+        Mat inside;
+        erode(roi.mask, inside, Mat(), Point(-1, -1), 1, BORDER_CONSTANT, Scalar(0));
+        subtract(roi.mask, inside, roi.edge);
+    }
+
+    return true;
+}
+
+// settingsError checks the detection settings and the publishing rate, the same way whether they come
+// from the command line or from a control message. It returns what is wrong, nullptr if they are valid.
+const char* settingsError(const Settings& conf, int rate)
+{
+    if (conf.threshold < 0 || conf.threshold > 255) {
+        return "The threshold must be between 0 and 255";
+    }
+    if (conf.min_area < 0) {
+        return "The minimum area must not be negative";
+    }
+    if (conf.max_area < conf.min_area) {
+        return "The maximum area must not be below the minimum area";
+    }
+    if (rate < 1) {
+        return "The rate must be at least 1 second";
+    }
+    return nullptr;
+}
+
+// applyControlMessage applies a control message such as {"minarea": 10000, "maxarea": 30000,
+// "threshold": 200, "rate": 1, "publish": "events", "roi": [{"input": 0, "x": 0, "y": 150,
+// "width": 960, "height": 250}]}. Every field is optional, an "roi" entry with only the input
+// number removes the region of interest of that input. Nothing is applied if any field is invalid.
+bool applyControlMessage(const json& msg)
+{
+    Settings next = *getSettings();
+    int next_rate = rate;
+    bool next_events = publish_events;
+
+    try {
+        if (msg.count("minarea")) {
+            next.min_area = msg.at("minarea").get<int>();
+        }
+        if (msg.count("maxarea")) {
+            next.max_area = msg.at("maxarea").get<int>();
+        }
+        if (msg.count("threshold")) {
+            next.threshold = msg.at("threshold").get<int>();
+        }
+        if (msg.count("rate")) {
+            next_rate = msg.at("rate").get<int>();
+        }
+        if (msg.count("publish")) {
+            string publish = msg.at("publish").get<string>();
+            if (publish != "events" && publish != "poll") {
+                return false;
+            }
+            next_events = publish == "events";
+        }
+        if (msg.count("roi")) {
+            json rois = msg.at("roi");
+            if (!rois.is_array()) {
+                rois = json::array({rois});
+            }
+            for (auto& r : rois) {
+                size_t id = r.at("input").get<size_t>();
+                if (id >= next.roi.size()) {
+                    return false;
+                }
+                Region roi;
+                if (r.size() > 1 && !parseRoi(r, roi, streams[id]->size)) {
+                    return false;
+                }
+                next.roi[id] = roi;
+            }
+        }
+    } catch (const json::exception&) {
+        return false;
+    }
+
+    const char* error = settingsError(next, next_rate);
+    if (error) {
+        syslog(LOG_WARNING, "%s", error);
+        return false;
+    }
+
+    setSettings(make_shared<Settings>(next));
+    rate = next_rate;
+    publish_events = next_events;
+    return true;
+}
+
+// message handler for the MQTT subscription to the control topic of the station
+int handleMQTTControlMessages(void *context, char *topicName, int topicLen, MQTTClient_message *message)
+{
+    if (log_level >= LOG_INFO) {
+        syslog(LOG_INFO, "MQTT message received: %s", topicName);
+    }
+
+    const char* payload = (const char*)message->payload;
+    json msg = json::parse(payload, payload + message->payloadlen, nullptr, false);
+    if (msg.is_object() && applyControlMessage(msg)) {
+        syslog(LOG_NOTICE, "Settings updated from %s", topicName);
+    } else {
+        syslog(LOG_WARNING, "Invalid control message on %s ignored", topicName);
+    }
+
+    MQTTClient_freeMessage(&message);
+    MQTTClient_free(topicName);
+    return 1;
+}
+
+// windowName returns the name of the display window for the stream
+string windowName(const Stream& s)
+{
+    string name = "Object Size Detector";
+    if (streams.size() > 1) {
+        name += " - input " + to_string(s.id);
+    }
+    return name;
+}
+
+// showFrame draws the measurement of the latest processed frame of the stream over it and displays it
+void showFrame(Stream& s)
+{
+    string label;
+    int total_parts, total_defects;
+    Mat frame;
+    AssemblyInfo info;
+
+    {
+        lock_guard<mutex> lock(s.display_m);
+        if (s.shown.empty()) {
+            // nothing new since the last call, the window keeps the previous frame
+            return;
+        }
+        frame = s.shown;
+        info = s.shownInfo;
+        s.shown.release();
+    }
+
+    // camera frames only hold the luma, they are converted to draw the overlay in color. Other frames
+    // are not read by anybody else any more, the overlay is drawn over them in place.
+    if (frame.channels() != 3) {
+        Mat luma = frame;
+        if (frame.channels() == 2) {
+            extractChannel(frame, luma, 0);
+        }
+        cvtColor(luma, frame, COLOR_GRAY2BGR);
+    }
+
+    shared_ptr<const Settings> conf = getSettings();
+    getTotals(s, total_parts, total_defects);
+    label = format("Measurement: %d Expected range: [%d - %d] Defect: %s",
+                    info.area, conf->min_area, conf->max_area, info.defect? "TRUE" : "FALSE");
+    putText(frame, label, Point(0, 15), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 255, 0));
+
+    label = format("Total parts: %d Total Defects: %d", total_parts, total_defects);
+    putText(frame, label, Point(0, 40), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 255, 0));
+
+    if (info.show) {
+        rectangle(frame, info.rect, Scalar(255, 0, 0), 1);
+    } else {
+        rectangle(frame, info.rect, Scalar(0, 255, 0), 1);
+    }
+
+    // outline the region of interest
+    const Region& roi = conf->roi[s.id];
+    if (!roi.rect.empty()) {
+        rectangle(frame, roi.rect, Scalar(0, 255, 255), 1);
+    }
+
+    imshow(windowName(s), frame);
+}
+
+// drainStreams waits until the workers have processed every frame queued on the streams,
+// or until the application is stopped
+void drainStreams()
+{
+    for (auto& s : streams) {
+        while (s->nextImage.size() > 0 && keepRunning.load()) {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        // the last frames may have been dequeued but still be in progress
+        while (keepRunning.load()) {
+            {
+                lock_guard<mutex> lock(s->pop_m);
+                if (s->tracked.load() == s->taken) {
+                    break;
+                }
+            }
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+}
+
+// skipFrame tells whether the capture leaves the frame it just grabbed undecoded. Whenever a frame is due
+// to be decoded, the queue of the stream is checked: the skip ratio goes up while the queue is still full,
+// so the workers lag behind, and down once it has run empty. No frame is skipped while a part is in view,
+// so the part tracking sees every frame of a part, nor when frames must not be lost.
+bool skipFrame(Stream& s) {
+    if (max_skip <= 0 || s.nextImage.policy() == FrameRing::BLOCK || s.part_in_view.load()) {
+        s.skipping = 0;
+        return false;
+    }
+    if (s.skipping > 0) {
+        s.skipping--;
+        s.skipped++;
+        return true;
+    }
+
+    size_t depth = s.nextImage.size();
+    if (depth >= s.nextImage.capacity()) {
+        s.skip = min(s.skip + 1, max_skip);
+    } else if (depth == 0 && s.skip > 0) {
+        s.skip--;
+    }
+    s.skipping = s.skip;
+    return false;
+}
+
+// Function called by the capture thread to decode the frames of every input into their queues. It only
+// grabs, decodes and resizes, so the display never holds up the cameras. Frames are grabbed first and
+// only retrieved when skipFrame keeps them, which spares the color conversion and resize of the frames
+// the workers would not keep up with. Video files are read at their
+// frame rate when displayed, and as fast as possible when headless. Once every input has ended it waits
+// for the workers to process the frames already captured, then stops the application.
+void captureRunner() {
+    auto tick = chrono::steady_clock::now();
+
+    while (keepRunning.load()) {
+        size_t running = 0;
+        for (auto& s : streams) {
+            if (s->finished) {
+                continue;
+            }
+
+            StageClock timer(s->stats);
+            if (!grabFrame(*s)) {
+                s->finished = true;
+                cerr << "ERROR! blank frame grabbed from " << s->input << "\n";
+                continue;
+            }
+            running++;
+            if (skipFrame(*s)) {
+                continue;
+            }
+
+            Mat buffer;
+            if (!retrieveFrame(*s, buffer)) {
+                s->finished = true;
+                cerr << "ERROR! blank frame grabbed from " << s->input << "\n";
+                continue;
+            }
+            timer.lap(STAGE_CAPTURE);
+            addImage(*s, buffer);
+        }
+
+        if (running == 0) {
+            // every input has ended, let the workers finish the frames already captured
+            drainStreams();
+            keepRunning = false;
+            break;
+        }
+
+        if (!headless) {
+            // the time spent reading counts towards the frame period, a late round starts the next one at once
+            tick += chrono::milliseconds(delay);
+            auto now = chrono::steady_clock::now();
+            if (tick > now) {
+                this_thread::sleep_until(tick);
+            } else {
+                tick = now;
+            }
+        }
+    }
+
+    cout << "Video capture thread stopped" << endl;
+}
+
+// printBenchmark prints the overall throughput and the per-stream latencies and totals
+void printBenchmark(double seconds)
+{
+    uint64_t frames = 0;
+    for (auto& s : streams) {
+        frames += s->stats.stages[STAGE_FRAME].count();
+    }
+
+    cout << "Benchmark: " << frames << " frames in " << seconds << " s ("
+         << (seconds > 0 ? frames / seconds : 0) << " frames/sec)" << endl;
+
+    for (auto& s : streams) {
+        int total_parts, total_defects;
+        getTotals(*s, total_parts, total_defects);
+
+        cout << "Input " << s->id << ": " << s->input << endl;
+        printStats(cout, s->stats);
+        cout << "Total parts: " << total_parts << " Total Defects: " << total_defects << endl;
+    }
+    printBufferStats();
+}
+
 int main(int argc, char** argv)
 {
     // parse command parameters
     CommandLineParser parser(argc, argv, keys);
-    String input;
     std::string conf_file = "../resources/config.json";
     std::ifstream confFile(conf_file);
     confFile>>jsonobj;
@@ -318,29 +1199,142 @@ int main(int argc, char** argv)
         return 0;
     }
 
-    min_area = parser.get<int>("minarea");
-    max_area = parser.get<int>("maxarea");
+    Settings initial;
+    initial.min_area = parser.get<int>("minarea");
+    initial.max_area = parser.get<int>("maxarea");
+    initial.threshold = parser.get<int>("threshold");
     rate = parser.get<int>("rate");
+    const char* error = settingsError(initial, rate);
+    if (error) {
+        cerr << "ERROR! " << error << "\n";
+        return -1;
+    }
+    stats_rate = parser.get<int>("statsrate");
+    heartbeat = parser.get<int>("heartbeat");
+    coalesce = parser.get<int>("coalesce");
+    log_level = parser.get<int>("loglevel");
+    setlogmask(LOG_UPTO(log_level));
+
+    string publish = parser.get<string>("publish");
+    if (publish == "events") {
+        publish_events = true;
+    } else if (publish != "poll") {
+        cerr << "ERROR! Unknown MQTT publishing mode " << publish << "\n";
+        return -1;
+    }
+    string format = parser.get<string>("format");
+    if (format == "cbor") {
+        payload_format = PAYLOAD_CBOR;
+    } else if (format == "msgpack") {
+        payload_format = PAYLOAD_MSGPACK;
+    } else if (format != "json") {
+        cerr << "ERROR! Unknown MQTT payload format " << format << "\n";
+        return -1;
+    }
+    int batch = parser.get<int>("batch");
+    if (batch < 1) {
+        cerr << "ERROR! The batch size must be at least 1\n";
+        return -1;
+    }
+    counterBatch.configure(batch, chrono::milliseconds(parser.get<int>("batchms")));
+    int workers = parser.get<int>("workers");
+    // one worker per core by default
+    if (workers <= 0) {
+        workers = max(1u, thread::hardware_concurrency());
+    }
+    reorder_window = 2 * workers;
+    headless = parser.has("headless");
+    int queue_size = max(1, parser.get<int>("queue"));
+    FrameRing::Policy policy = parser.has("block") ? FrameRing::BLOCK : FrameRing::OVERWRITE_OLDEST;
+
+    // benchmark must not lose any frame, and is not paced by the display
+    benchmark = parser.has("benchmark");
+    verify = parser.has("verify");
+    fused = parser.has("fused");
+    max_skip = parser.get<int>("maxskip");
+    native = parser.has("native");
+    bands = parser.get<int>("bands");
+
+    string camera = parser.get<string>("capture");
+    if (camera == "opencv") {
+        v4l2 = false;
+    } else if (camera != "v4l2") {
+        cerr << "ERROR! Unknown camera capture " << camera << "\n";
+        return -1;
+    }
+
+    string blobs = parser.get<string>("blobs");
+    if (blobs == "components") {
+        blob_method = BLOBS_COMPONENTS;
+    } else if (blobs != "contours") {
+        cerr << "ERROR! Unknown blob extraction method " << blobs << "\n";
+        return -1;
+    }
+    if (benchmark) {
+        headless = true;
+        policy = FrameRing::BLOCK;
+    }
 
     auto obj = jsonobj["inputs"];
-    input = obj[0]["video"];
+    for (size_t i = 0; i < obj.size(); i++) {
+        unique_ptr<Stream> s(new Stream(i, obj[i]["video"].get<string>(), queue_size, policy));
 
-    if (input.size() == 1 && *(input.c_str()) >= '0' && *(input.c_str()) <= '9')
-        cap.open(std::stoi(input));
-    else
-        cap.open(input);
+        // a camera frame is held by the queue, by the reorder window while it is processed or waits for
+        // the part tracking, and by the display, the driver needs a few more to capture into
+        if (!openStream(*s, queue_size + (int)reorder_window + 4))
+        {
+            cerr << "ERROR! Unable to open video source " << s->input << "\n";
+            return -1;
+        }
+        if (!native) {
+            s->size = frame_size;
+        } else if (s->camera.isOpened()) {
+            s->size = s->camera.size();
+        } else {
+            s->size = Size((int)s->cap.get(CAP_PROP_FRAME_WIDTH), (int)s->cap.get(CAP_PROP_FRAME_HEIGHT));
+        }
+
+        Region roi;
+        if (obj[i].count("roi") && !parseRoi(obj[i]["roi"], roi, s->size))
+        {
+            cerr << "ERROR! Invalid region of interest for video source " << s->input << "\n";
+            return -1;
+        }
+        streams.push_back(move(s));
+        initial.roi.push_back(roi);
+    }
+    setSettings(make_shared<Settings>(initial));
 
-    if (!cap.isOpened())
+    if (streams.empty())
     {
-        cerr << "ERROR! Unable to open video source\n";
+        cerr << "ERROR! No video inputs in " << conf_file << "\n";
         return -1;
     }
 
-    // Also adjust delay so video playback matches the number of FPS in the file
-    double fps = cap.get(CAP_PROP_FPS);
-    delay = 1000 / fps;
+    // Also adjust delay so video playback matches the number of FPS of the fastest input
+    double fps = 0;
+    for (auto& s : streams) {
+        fps = max(fps, s->camera.isOpened() ? s->camera.fps() : s->cap.get(CAP_PROP_FPS));
+    }
+    if (fps > 0) {
+        delay = 1000 / fps;
+    }
+    int ui_fps = parser.get<int>("uifps");
+    ui_delay = ui_fps > 0 ? max(1, 1000 / ui_fps) : delay;
 
     // connect MQTT messaging
+    string outbox = parser.get<string>("outbox");
+    size_t outbox_size = (size_t)max(0, parser.get<int>("outboxsize")) * 1024;
+    if (!outbox.empty() && mqtt_open_outbox(outbox, outbox_size, parser.get<int>("drainrate")) != 0) {
+        cerr << "ERROR! Unable to open the MQTT outbox " << outbox << "\n";
+        return -1;
+    }
+    // a batch keeps growing with the JSON of each message
+    if (!outbox.empty() && (size_t)batch * PAYLOAD_MAX > outbox_size) {
+        cerr << "WARNING! Batches of " << batch << " messages may not fit in an outbox of " << outbox_size / 1024
+             << " KB, use a larger -outboxsize\n";
+    }
+
     int result = mqtt_start(handleMQTTControlMessages);
     if (result == 0) {
         syslog(LOG_INFO, "MQTT started.");
@@ -348,61 +1342,93 @@ int main(int argc, char** argv)
         syslog(LOG_INFO, "MQTT NOT started: have you set the ENV varables?");
     }
 
-    mqtt_connect();
+    // settings can be changed at runtime on the control topic of the station
+    if (result == 0) {
+        string control_topic = "defects/control/" + std_getenv("MQTT_CLIENT_ID");
+        mqtt_subscribe(control_topic);
+        syslog(LOG_INFO, "MQTT control topic: %s", control_topic.c_str());
+    }
+
+    if (result == 0 && mqtt_connect() != MQTTCLIENT_SUCCESS) {
+        syslog(LOG_WARNING, "MQTT server unreachable, retrying in the background.");
+    }
 
     // register SIGTERM signal handler
     signal(SIGTERM, handle_sigterm);
+    // register SIGUSR1 signal handler to dump statistics
+    signal(SIGUSR1, handle_sigusr1);
 
     // start worker threads
-    thread t1(frameRunner);
+    vector<thread> pool;
+    for (int i = 0; i < workers; i++) {
+        pool.push_back(thread(frameRunner));
+    }
     thread t2(messageRunner);
 
-    string label;
-    // read video input data
-    for (;;) {
-        cap.read(frame);
+    auto started = chrono::steady_clock::now();
+    thread capture(captureRunner);
 
-        if (frame.empty()) {
-            keepRunning = false;
-            cerr << "ERROR! blank frame grabbed\n";
-            break;
+    // the main thread displays the latest processed frame of each input at its own rate, and handles
+    // the keyboard and the signals, until the capture thread stops once every input has ended
+    while (keepRunning.load()) {
+        if (stats_requested) {
+            stats_requested = 0;
+            dumpStats();
         }
 
-        resize(frame, frame, Size(960, 540));
-        displayFrame = frame.clone();
-        addImage(frame);
-
-        AssemblyInfo info = getCurrentInfo();
-        label = format("Measurement: %d Expected range: [%d - %d] Defect: %s",
-                        info.area, min_area, max_area, info.defect? "TRUE" : "FALSE");
-        putText(displayFrame, label, Point(0, 15), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 255, 0));
-
-        label = format("Total parts: %d Total Defects: %d", total_parts, total_defects);
-        putText(displayFrame, label, Point(0, 40), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(0, 255, 0));
-
-        if (info.show) {
-            rectangle(displayFrame, info.rect, Scalar(255, 0, 0), 1);
+        if (headless) {
+            this_thread::sleep_for(chrono::milliseconds(10));
         } else {
-            rectangle(displayFrame, info.rect, Scalar(0, 255, 0), 1);
+            for (auto& s : streams) {
+                showFrame(*s);
+            }
+            if (waitKey(ui_delay) >= 0) {
+                sig_caught = 1;
+            }
         }
 
-        imshow("Object Size Detector", displayFrame);
-
-        if (waitKey(delay) >= 0 || sig_caught) {
+        if (sig_caught) {
             cout << "Attempting to stop background threads" << endl;
             keepRunning = false;
-            break;
         }
     }
 
+    // wake up the capture thread if it waits for a queue slot, and the idle workers, so they notice
+    // keepRunning is cleared
+    frameSignal.shutdown();
+    partEvents.shutdown();
+    for (auto& s : streams) {
+        s->nextImage.close();
+    }
+
     // wait for the threads to finish
-    t1.join();
+    capture.join();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    for (auto& t : pool) {
+        t.join();
+    }
     t2.join();
-    cap.release();
+    for (auto& s : streams) {
+        s->cap.release();
+        s->camera.close();
+        cout << "Input " << s->id << ": " << s->nextImage.pushed() << " frames queued, "
+             << s->nextImage.dropped() << " dropped, " << s->skipped << " skipped" << endl;
+        if (verify) {
+            cout << "Input " << s->id << ": " << s->verified_frames << " frames verified, "
+                 << s->mismatched_frames << " preprocessing mismatches" << endl;
+        }
+    }
+
+    if (benchmark) {
+        printBenchmark(elapsed);
+    }
 
     // disconnect MQTT messaging
     mqtt_disconnect();
     mqtt_close();
+    if (result == 0) {
+        printMQTTStats();
+    }
 
     return 0;
 }
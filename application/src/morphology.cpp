@@ -0,0 +1,162 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MORPHOLOGY_X86 1
+#endif
+
+#include "morphology.h"
+
+using namespace cv;
+
+#ifdef MORPHOLOGY_X86
+// crossRowSSE2/crossRowAVX2 process the columns [x, end) and return the first column left over.
+// They read mid[x - 1] to mid[end], so x must be at least 1 and end at most width - 1.
+__attribute__((target("sse2")))
+static int crossRowSSE2(const uchar* up, const uchar* mid, const uchar* down, uchar* out, int x, int end, bool erode)
+{
+    if (erode) {
+        for (; x + 16 <= end; x += 16) {
+            __m128i v = _mm_min_epu8(_mm_loadu_si128((const __m128i*)(up + x)), _mm_loadu_si128((const __m128i*)(down + x)));
+            __m128i h = _mm_min_epu8(_mm_loadu_si128((const __m128i*)(mid + x - 1)), _mm_loadu_si128((const __m128i*)(mid + x + 1)));
+            v = _mm_min_epu8(v, _mm_loadu_si128((const __m128i*)(mid + x)));
+            _mm_storeu_si128((__m128i*)(out + x), _mm_min_epu8(v, h));
+        }
+    } else {
+        for (; x + 16 <= end; x += 16) {
+            __m128i v = _mm_max_epu8(_mm_loadu_si128((const __m128i*)(up + x)), _mm_loadu_si128((const __m128i*)(down + x)));
+            __m128i h = _mm_max_epu8(_mm_loadu_si128((const __m128i*)(mid + x - 1)), _mm_loadu_si128((const __m128i*)(mid + x + 1)));
+            v = _mm_max_epu8(v, _mm_loadu_si128((const __m128i*)(mid + x)));
+            _mm_storeu_si128((__m128i*)(out + x), _mm_max_epu8(v, h));
+        }
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+static int crossRowAVX2(const uchar* up, const uchar* mid, const uchar* down, uchar* out, int x, int end, bool erode)
+{
+    if (erode) {
+        for (; x + 32 <= end; x += 32) {
+            __m256i v = _mm256_min_epu8(_mm256_loadu_si256((const __m256i*)(up + x)), _mm256_loadu_si256((const __m256i*)(down + x)));
+            __m256i h = _mm256_min_epu8(_mm256_loadu_si256((const __m256i*)(mid + x - 1)), _mm256_loadu_si256((const __m256i*)(mid + x + 1)));
+            v = _mm256_min_epu8(v, _mm256_loadu_si256((const __m256i*)(mid + x)));
+            _mm256_storeu_si256((__m256i*)(out + x), _mm256_min_epu8(v, h));
+        }
+    } else {
+        for (; x + 32 <= end; x += 32) {
+            __m256i v = _mm256_max_epu8(_mm256_loadu_si256((const __m256i*)(up + x)), _mm256_loadu_si256((const __m256i*)(down + x)));
+            __m256i h = _mm256_max_epu8(_mm256_loadu_si256((const __m256i*)(mid + x - 1)), _mm256_loadu_si256((const __m256i*)(mid + x + 1)));
+            v = _mm256_max_epu8(v, _mm256_loadu_si256((const __m256i*)(mid + x)));
+            _mm256_storeu_si256((__m256i*)(out + x), _mm256_max_epu8(v, h));
+        }
+    }
+    return x;
+}
+#endif
+
+struct MinOp { uchar operator()(uchar a, uchar b) const { return std::min(a, b); } };
+struct MaxOp { uchar operator()(uchar a, uchar b) const { return std::max(a, b); } };
+
+template<typename Op>
+static void crossRow(const uchar* up, const uchar* mid, const uchar* down, uchar* out, int width, bool erode)
+{
+    Op op;
+
+    // a missing row does not change the min/max of the center pixel
+    if (!up) up = mid;
+    if (!down) down = mid;
+
+    if (width == 1) {
+        out[0] = op(op(up[0], down[0]), mid[0]);
+        return;
+    }
+
+    out[0] = op(op(op(up[0], down[0]), mid[0]), mid[1]);
+
+    int x = 1;
+#ifdef MORPHOLOGY_X86
+    static const bool avx2 = checkHardwareSupport(CV_CPU_AVX2);
+    x = avx2 ? crossRowAVX2(up, mid, down, out, x, width - 1, erode)
+             : crossRowSSE2(up, mid, down, out, x, width - 1, erode);
+#endif
+    for (; x < width - 1; x++) {
+        out[x] = op(op(op(up[x], down[x]), mid[x]), op(mid[x - 1], mid[x + 1]));
+    }
+
+    out[width - 1] = op(op(op(up[width - 1], down[width - 1]), mid[width - 1]), mid[width - 2]);
+}
+
+void erodeCrossRow(const uchar* up, const uchar* mid, const uchar* down, uchar* out, int width)
+{
+    crossRow<MinOp>(up, mid, down, out, width, true);
+}
+
+void dilateCrossRow(const uchar* up, const uchar* mid, const uchar* down, uchar* out, int width)
+{
+    crossRow<MaxOp>(up, mid, down, out, width, false);
+}
+
+static void crossImage(const Mat& src, Mat& dst, bool erode)
+{
+    // rows are computed from their neighbours, so working in place needs a copy of the input
+    Mat in = src.data == dst.data ? src.clone() : src;
+    dst.create(in.rows, in.cols, CV_8UC1);
+
+    for (int y = 0; y < in.rows; y++) {
+        const uchar* up = y > 0 ? in.ptr<uchar>(y - 1) : nullptr;
+        const uchar* down = y < in.rows - 1 ? in.ptr<uchar>(y + 1) : nullptr;
+        if (erode) {
+            erodeCrossRow(up, in.ptr<uchar>(y), down, dst.ptr<uchar>(y), in.cols);
+        } else {
+            dilateCrossRow(up, in.ptr<uchar>(y), down, dst.ptr<uchar>(y), in.cols);
+        }
+    }
+}
+
+void erodeCross(const Mat& src, Mat& dst)
+{
+    crossImage(src, dst, true);
+}
+
+void dilateCross(const Mat& src, Mat& dst)
+{
+    crossImage(src, dst, false);
+}
+
+void morphologyCross(const Mat& src, Mat& dst, int op, Mat& tmp)
+{
+    // the first step always writes to tmp so src and dst may be the same image
+    if (op == MORPH_CLOSE) {
+        dilateCross(src, tmp);
+        erodeCross(tmp, dst);
+    } else {
+        erodeCross(src, tmp);
+        dilateCross(tmp, dst);
+    }
+}
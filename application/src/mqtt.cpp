@@ -21,14 +21,89 @@
 * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <thread>
+
 #include "mqtt.h"
+#include "outbox.h"
 
 bool mqtt_initialized = false;
 MQTTClient client;
 MQTTClient_connectOptions conn_opts = MQTTClient_connectOptions_initializer;
-MQTTClient_message pubmsg = MQTTClient_message_initializer;
-MQTTClient_deliveryToken token;
 MQTTClient_SSLOptions sslOptions = MQTTClient_SSLOptions_initializer;
+// the connect options point into this copy of the configuration, they are used again on every reconnect
+mqtt_service_config service_config;
+
+// outbound queue of messages, sent by the sender thread so publishers never wait for the broker
+struct mqtt_message
+{
+    std::string topic;
+    std::string payload;
+};
+
+// ring of MAX_QUEUED messages; a slot keeps the capacity of its strings from one message to
+// the next, so once the ring has warmed up queueing a message does not allocate
+std::vector<mqtt_message> outbound(MAX_QUEUED);
+size_t outbound_head = 0;
+size_t outbound_size = 0;
+std::mutex outbound_m;
+// signaled when a message is queued or the sender is stopped
+std::condition_variable outbound_cv;
+// signaled when the broker acknowledges a message
+std::condition_variable inflight_cv;
+std::thread sender;
+bool sender_running = false;
+
+// messages handed to paho and not acknowledged yet, by delivery token. With an outbox every message
+// sent is kept in it until the broker acknowledges it, seq is its number there, NO_SEQ otherwise.
+// early_acks are the acknowledgements that came in while the sender was publishing, before it
+// recorded the message. write_offs counts the write-offs, a token from before one is not recorded.
+const uint64_t NO_SEQ = UINT64_MAX;
+struct mqtt_inflight
+{
+    MQTTClient_deliveryToken token;
+    uint64_t seq;
+};
+std::vector<mqtt_inflight> inflight;
+std::vector<MQTTClient_deliveryToken> early_acks;
+uint64_t write_offs = 0;
+// connection state, the supervisor thread reconnects with an exponential backoff whenever
+// the connection is lost
+std::atomic<int> state(MQTT_DISCONNECTED);
+std::atomic<bool> connected(false);
+std::mutex supervisor_m;
+// signaled when the connection is lost or the supervisor is stopped
+std::condition_variable supervisor_cv;
+std::thread supervisor;
+bool supervisor_running = false;
+// topics subscribed again on every connection, the broker forgets them with the clean session
+std::vector<std::string> subscriptions;
+
+// messages published while the broker is unreachable are kept in the outbox, guarded by outbound_m.
+// Once connected they are sent again at outbox_drain_rate messages per second, in batches every
+// OUTBOX_BATCH_MS; outbox_budget is what is left of the current batch. outbox_next is the number of
+// the next message to send from the outbox, the ones before it are in flight or acknowledged.
+Outbox outbox;
+uint64_t outbox_next = 0;
+int outbox_drain_rate = 0;
+int outbox_budget = 0;
+std::chrono::steady_clock::time_point outbox_next_batch;
+
+std::atomic<uint64_t> queued_count(0);
+std::atomic<uint64_t> dropped_count(0);
+std::atomic<uint64_t> published_count(0);
+std::atomic<uint64_t> delivered_count(0);
+std::atomic<uint64_t> failed_count(0);
+std::atomic<uint64_t> stored_count(0);
+std::atomic<uint64_t> drained_count(0);
+std::atomic<uint64_t> oversize_count(0);
+std::atomic<uint64_t> reconnect_count(0);
+std::atomic<uint64_t> connect_failed_count(0);
 
 std::string std_getenv(const std::string &name)
 {
@@ -60,50 +135,27 @@ void mqtt_init(mqtt_service_config const &config)
                       NULL);
 
     // connection options
+    service_config = config;
     conn_opts.keepAliveInterval = 20;
     conn_opts.cleansession = 1;
+    conn_opts.connectTimeout = CONNECT_TIMEOUT;
 
-    if (!config.username.empty())
+    if (!service_config.username.empty())
     {
-        std::vector<char> username_c(
-            config.username.c_str(),
-            config.username.c_str() + config.username.size() + 1
-        );
-        
-        conn_opts.username = &username_c[0];
+        conn_opts.username = service_config.username.c_str();
     }
 
-    if (!config.password.empty())
+    if (!service_config.password.empty())
     {
-        std::vector<char> password_c(
-            config.password.c_str(),
-            config.password.c_str() + config.password.size() + 1
-        );
-        
-        conn_opts.password = &password_c[0];
+        conn_opts.password = service_config.password.c_str();
     }
 
     // ssl options
-    if (!config.cert.empty() && !config.cert_key.empty() && !config.ca_root.empty())
-    {
-        std::vector<char> cert_c(
-            config.cert.c_str(),
-            config.cert.c_str() + config.cert.size() + 1
-        );
-
-        std::vector<char> cert_key_c(
-            config.cert_key.c_str(),
-            config.cert_key.c_str() + config.cert_key.size() + 1
-        );
-
-        std::vector<char> ca_root_c(
-            config.ca_root.c_str(),
-            config.ca_root.c_str() + config.ca_root.size() + 1
-        );
-        
-        sslOptions.keyStore = &cert_c[0];
-        sslOptions.privateKey = &cert_key_c[0];
-        sslOptions.trustStore = &ca_root_c[0];
+    if (!service_config.cert.empty() && !service_config.cert_key.empty() && !service_config.ca_root.empty())
+    {
+        sslOptions.keyStore = service_config.cert.c_str();
+        sslOptions.privateKey = service_config.cert_key.c_str();
+        sslOptions.trustStore = service_config.ca_root.c_str();
     }
     else
     {
@@ -114,6 +166,346 @@ void mqtt_init(mqtt_service_config const &config)
     mqtt_initialized = true;
 };
 
+// mqtt_acknowledge removes an acknowledged message from the in-flight ones and from the outbox,
+// it returns false if the sender did not record it. Called with outbound_m held.
+bool mqtt_acknowledge(MQTTClient_deliveryToken dt)
+{
+    for (size_t i = 0; i < inflight.size(); i++) {
+        if (inflight[i].token == dt) {
+            if (inflight[i].seq != NO_SEQ) {
+                outbox.remove(inflight[i].seq);
+            }
+            inflight.erase(inflight.begin() + i);
+            delivered_count++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// mqtt_write_off gives up on the acknowledgements of the messages in flight once the connection
+// is lost. Those kept in the outbox are sent again, the others are lost. Called with outbound_m held.
+void mqtt_write_off()
+{
+    write_offs++;
+    for (auto& m : inflight) {
+        if (m.seq != NO_SEQ) {
+            outbox_next = std::min(outbox_next, m.seq);
+        } else {
+            failed_count++;
+        }
+    }
+    inflight.clear();
+    early_acks.clear();
+}
+
+// mqtt_delivered is called by the paho client thread when the broker acknowledged a message
+void mqtt_delivered(void *context, MQTTClient_deliveryToken dt)
+{
+    std::lock_guard<std::mutex> lock(outbound_m);
+    bool publishing = std::any_of(inflight.begin(), inflight.end(),
+                                  [](const mqtt_inflight& m) { return m.token == -1; });
+    if (!mqtt_acknowledge(dt) && publishing) {
+        // the sender records the message once paho returns, which may be after the acknowledgement
+        if (early_acks.size() >= MAX_INFLIGHT) {
+            early_acks.erase(early_acks.begin());
+        }
+        early_acks.push_back(dt);
+    }
+    inflight_cv.notify_one();
+}
+
+// mqtt_set_disconnected records the loss of the connection and wakes up the supervisor
+void mqtt_set_disconnected()
+{
+    {
+        std::lock_guard<std::mutex> lock(supervisor_m);
+        if (!connected) {
+            return;
+        }
+        connected = false;
+        state = MQTT_DISCONNECTED;
+    }
+    supervisor_cv.notify_one();
+}
+
+// mqtt_connection_lost is called by the paho client thread when the connection to the broker is lost
+void mqtt_connection_lost(void *context, char *cause)
+{
+    mqtt_set_disconnected();
+}
+
+// mqtt_try_connect makes one connection attempt, it returns the paho return code
+int mqtt_try_connect()
+{
+    state = MQTT_CONNECTING;
+
+    // the new clean session will not acknowledge what was sent on the previous one. Writing off
+    // before connecting leaves every message sent on the new session to be acknowledged.
+    {
+        std::lock_guard<std::mutex> lock(outbound_m);
+        mqtt_write_off();
+    }
+    inflight_cv.notify_one();
+
+    int rc = MQTTClient_connect(client, &conn_opts);
+    if (rc != MQTTCLIENT_SUCCESS) {
+        connect_failed_count++;
+        state = MQTT_DISCONNECTED;
+        return rc;
+    }
+
+    std::vector<std::string> topics;
+    {
+        std::lock_guard<std::mutex> lock(supervisor_m);
+        connected = true;
+        state = MQTT_CONNECTED;
+        topics = subscriptions;
+    }
+    for (auto& topic : topics) {
+        MQTTClient_subscribe(client, topic.c_str(), QOS);
+    }
+    // the sender may have an outbox to drain
+    outbound_cv.notify_one();
+    return rc;
+}
+
+// mqtt_supervisor reconnects whenever the connection is lost. Attempts are spaced by an exponential
+// backoff from RECONNECT_MIN_MS to RECONNECT_MAX_MS with jitter, so a fleet of stations does not
+// hammer a restarted broker in lockstep.
+void mqtt_supervisor()
+{
+    std::mt19937 rng(std::random_device{}());
+    long backoff = RECONNECT_MIN_MS;
+
+    std::unique_lock<std::mutex> lock(supervisor_m);
+    for (;;) {
+        supervisor_cv.wait(lock, []{ return !connected || !supervisor_running; });
+        if (!supervisor_running) {
+            break;
+        }
+
+        lock.unlock();
+        int rc = mqtt_try_connect();
+        lock.lock();
+        if (rc == MQTTCLIENT_SUCCESS) {
+            reconnect_count++;
+            backoff = RECONNECT_MIN_MS;
+            continue;
+        }
+
+        // wait between half and all of the backoff
+        std::uniform_int_distribution<long> jitter(backoff / 2, backoff);
+        supervisor_cv.wait_for(lock, std::chrono::milliseconds(jitter(rng)), []{ return !supervisor_running; });
+        backoff = std::min(backoff * 2, RECONNECT_MAX_MS);
+    }
+}
+
+// mqtt_stop_supervisor stops reconnecting
+void mqtt_stop_supervisor()
+{
+    {
+        std::lock_guard<std::mutex> lock(supervisor_m);
+        if (!supervisor_running) {
+            return;
+        }
+        supervisor_running = false;
+    }
+    supervisor_cv.notify_all();
+    supervisor.join();
+}
+
+// mqtt_store saves a message to the outbox, or drops it if there is none or it is larger than the
+// whole outbox. Called with outbound_m held.
+void mqtt_store(const char* topic, size_t topic_len, const char* payload, size_t len)
+{
+    if (!outbox.isOpen()) {
+        dropped_count++;
+    } else if (outbox.push(topic, topic_len, payload, len)) {
+        stored_count++;
+    } else {
+        oversize_count++;
+    }
+}
+
+// mqtt_outbox_waiting tells whether the outbox may hold messages to send. Called with outbound_m held.
+bool mqtt_outbox_waiting()
+{
+    return outbox.isOpen() && std::max(outbox_next, outbox.first()) < outbox.end();
+}
+
+// mqtt_outbox_next copies the next message to send from the outbox, skipping the ones in flight,
+// it returns its number or NO_SEQ if there is none. Called with outbound_m held.
+uint64_t mqtt_outbox_next(std::string& topic, std::string& payload)
+{
+    for (outbox_next = std::max(outbox_next, outbox.first()); outbox_next < outbox.end(); outbox_next++) {
+        bool sent = false;
+        for (auto& m : inflight) {
+            sent = sent || m.seq == outbox_next;
+        }
+        if (!sent && outbox.get(outbox_next, topic, payload)) {
+            return outbox_next++;
+        }
+    }
+    return NO_SEQ;
+}
+
+// mqtt_drain_due tells whether a message of the outbox may be sent now, starting a new batch
+// if the last one is over. Called with outbound_m held.
+bool mqtt_drain_due()
+{
+    if (!mqtt_outbox_waiting() || !connected) {
+        return false;
+    }
+    if (outbox_budget == 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now < outbox_next_batch) {
+            return false;
+        }
+        outbox_budget = std::max(1, outbox_drain_rate * OUTBOX_BATCH_MS / 1000);
+        outbox_next_batch = now + std::chrono::milliseconds(OUTBOX_BATCH_MS);
+    }
+    return true;
+}
+
+// mqtt_sender sends the queued messages, keeping at most MAX_INFLIGHT of them unacknowledged.
+// With an outbox, each message is kept in it until the broker acknowledges it, so the messages
+// lost with the connection are sent again. The outbox is drained when there is nothing else to send.
+void mqtt_sender()
+{
+    std::unique_lock<std::mutex> lock(outbound_m);
+    mqtt_message msg;
+
+    for (;;) {
+        while (outbound_size == 0 && sender_running && !mqtt_drain_due()) {
+            if (mqtt_outbox_waiting()) {
+                outbound_cv.wait_for(lock, std::chrono::milliseconds(OUTBOX_BATCH_MS));
+            } else {
+                outbound_cv.wait(lock);
+            }
+        }
+        if (!sender_running) {
+            break;
+        }
+
+        auto slot_free = []{ return inflight.size() < MAX_INFLIGHT || !sender_running; };
+        while (!inflight_cv.wait_for(lock, std::chrono::milliseconds(TIMEOUT), slot_free)) {
+            // a slow broker still acknowledges the messages in flight, only a lost connection does not
+            if (!connected) {
+                mqtt_write_off();
+            }
+        }
+        if (!sender_running) {
+            break;
+        }
+
+        bool from_outbox = outbound_size == 0;
+        uint64_t seq = NO_SEQ;
+        if (from_outbox) {
+            seq = mqtt_outbox_next(msg.topic, msg.payload);
+            if (seq == NO_SEQ) {
+                continue;
+            }
+            outbox_budget--;
+        } else {
+            // trade buffers with the slot instead of copying the message out
+            mqtt_message& slot = outbound[outbound_head];
+            msg.topic.swap(slot.topic);
+            msg.payload.swap(slot.payload);
+            outbound_head = (outbound_head + 1) % MAX_QUEUED;
+            outbound_size--;
+            // keep it until the broker acknowledges it
+            if (outbox.isOpen() && outbox.push(msg.topic.data(), msg.topic.size(), msg.payload.data(), msg.payload.size())) {
+                seq = outbox.end() - 1;
+                if (outbox_next == seq) {
+                    outbox_next++;
+                }
+            }
+        }
+        // hold the in-flight slot while paho sends the message
+        inflight.push_back(mqtt_inflight{-1, seq});
+        uint64_t generation = write_offs;
+        lock.unlock();
+
+        MQTTClient_message pubmsg = MQTTClient_message_initializer;
+        MQTTClient_deliveryToken token;
+        pubmsg.payload = (void*)msg.payload.data();
+        pubmsg.payloadlen = msg.payload.size();
+        pubmsg.qos = QOS;
+        pubmsg.retained = 0;
+        int result = MQTTClient_publishMessage(client, msg.topic.c_str(), &pubmsg, &token);
+        if (result != MQTTCLIENT_SUCCESS && !MQTTClient_isConnected(client)) {
+            mqtt_set_disconnected();
+        }
+
+        lock.lock();
+        // a write-off may have released the slot in the meantime, the token is then left out
+        auto slot = std::find_if(inflight.begin(), inflight.end(),
+                                 [](const mqtt_inflight& m) { return m.token == -1; });
+        bool early = std::find(early_acks.begin(), early_acks.end(), token) != early_acks.end();
+        // only this message was being published, the other early acknowledgements are stale
+        early_acks.clear();
+        if (result == MQTTCLIENT_SUCCESS) {
+            published_count++;
+            if (from_outbox) {
+                drained_count++;
+            }
+            if (slot != inflight.end() && generation == write_offs) {
+                slot->token = token;
+                if (early) {
+                    mqtt_acknowledge(token);
+                }
+            }
+        } else {
+            if (slot != inflight.end()) {
+                inflight.erase(slot);
+            }
+            if (seq != NO_SEQ) {
+                // it stays in the outbox, retry with the next batch
+                outbox_next = std::min(outbox_next, seq);
+                outbox_budget = 0;
+            } else if (outbox.isOpen()) {
+                // it did not fit in the outbox, mqtt_store counts it as too large
+                mqtt_store(msg.topic.data(), msg.topic.size(), msg.payload.data(), msg.payload.size());
+            } else {
+                failed_count++;
+            }
+        }
+        inflight_cv.notify_one();
+    }
+}
+
+// mqtt_stop_sender stops the sender thread, messages still queued are moved to the outbox or dropped
+void mqtt_stop_sender()
+{
+    {
+        std::lock_guard<std::mutex> lock(outbound_m);
+        if (!sender_running) {
+            return;
+        }
+        sender_running = false;
+        for (; outbound_size > 0; outbound_size--) {
+            mqtt_message& slot = outbound[outbound_head];
+            mqtt_store(slot.topic.data(), slot.topic.size(), slot.payload.data(), slot.payload.size());
+            outbound_head = (outbound_head + 1) % MAX_QUEUED;
+        }
+        outbound_head = 0;
+    }
+    outbound_cv.notify_all();
+    inflight_cv.notify_all();
+    sender.join();
+}
+
+int mqtt_open_outbox(std::string const &path, size_t size, int drain_rate)
+{
+    std::lock_guard<std::mutex> lock(outbound_m);
+    if (!outbox.open(path, size)) {
+        return -1;
+    }
+    outbox_drain_rate = drain_rate;
+    return 0;
+}
+
 int mqtt_start(MQTTClient_messageArrived* msgrcv)
 {
     auto mqtt_config_result = get_mqtt_config();
@@ -129,65 +521,127 @@ int mqtt_start(MQTTClient_messageArrived* msgrcv)
     }
 
     mqtt_init(mqtt_config);
-    MQTTClient_setCallbacks(client, NULL, NULL, msgrcv, NULL);
+    MQTTClient_setCallbacks(client, NULL, mqtt_connection_lost, msgrcv, mqtt_delivered);
+
+    sender_running = true;
+    sender = std::thread(mqtt_sender);
     return 0;
 }
 
 void mqtt_close()
 {
+    mqtt_stop_supervisor();
+    mqtt_stop_sender();
     if (mqtt_initialized)
     {
         //std::cout << "Closing MQTT..." << std::endl;
         MQTTClient_destroy(&client);
     }
+    outbox.close();
 };
 
-void mqtt_connect()
+int mqtt_connect()
 {
-    if (mqtt_initialized)
+    if (!mqtt_initialized)
     {
-        int rc;
-        if ((rc = MQTTClient_connect(client, &conn_opts)) != MQTTCLIENT_SUCCESS)
-        {
-            //std::cout << "Failed to connect to MQTT server, return code:" << rc << std::endl;
-            return;
-        }
+        return MQTTCLIENT_FAILURE;
+    }
+
+    int rc = mqtt_try_connect();
+
+    // from now on the supervisor keeps the connection up, starting with retrying a failed attempt
+    std::lock_guard<std::mutex> lock(supervisor_m);
+    if (!supervisor_running)
+    {
+        supervisor_running = true;
+        supervisor = std::thread(mqtt_supervisor);
     }
+    return rc;
 }
 
 void mqtt_disconnect()
 {
-    if (mqtt_initialized)
+    mqtt_stop_supervisor();
+    mqtt_stop_sender();
+    if (mqtt_initialized && connected)
     {
-        MQTTClient_disconnect(client, 10000);
+        MQTTClient_disconnect(client, TIMEOUT);
+        connected = false;
+        state = MQTT_DISCONNECTED;
     }
 }
 
 int mqtt_publish(std::string const &topic, std::string const &message)
+{
+    return mqtt_publish(topic.c_str(), message.data(), message.size());
+}
+
+int mqtt_publish(const char *topic, const char *payload, size_t len)
 {
     if (!mqtt_initialized) {
         return -1;
     }
 
-    std::vector<char> topic_c(
-        topic.c_str(),
-        topic.c_str() + topic.size() + 1
-    );
-
-    std::vector<char> message_c(
-        message.c_str(),
-        message.c_str() + message.size() + 1
-    );
+    {
+        std::lock_guard<std::mutex> lock(outbound_m);
+        if (!sender_running || outbound_size >= MAX_QUEUED) {
+            dropped_count++;
+            return -1;
+        }
+        if (outbox.isOpen() && !connected) {
+            // no point queueing what cannot be sent, keep it for later
+            mqtt_store(topic, strlen(topic), payload, len);
+            return 0;
+        }
+        mqtt_message& slot = outbound[(outbound_head + outbound_size) % MAX_QUEUED];
+        slot.topic.assign(topic);
+        slot.payload.assign(payload, len);
+        outbound_size++;
+    }
+    queued_count++;
+    outbound_cv.notify_one();
+    return 0;
+}
 
-    pubmsg.payload = &message_c[0];
-    pubmsg.payloadlen = strlen(&message_c[0]);
-    pubmsg.qos = QOS;
-    pubmsg.retained = 0;
-    int result = MQTTClient_publishMessage(client, &topic_c[0], &pubmsg, &token);
-    if (result != 0) { // MQTTCLIENT_SUCCESS = 0
-        return result;
+const char* mqtt_state_name(mqtt_state state)
+{
+    switch (state) {
+    case MQTT_DISCONNECTED:
+        return "disconnected";
+    case MQTT_CONNECTING:
+        return "connecting";
+    case MQTT_CONNECTED:
+        return "connected";
     }
-    return MQTTClient_waitForCompletion(client, token, TIMEOUT);
+    return "unknown";
+}
+
+mqtt_state mqtt_get_state()
+{
+    return (mqtt_state)state.load();
+}
+
+mqtt_stats mqtt_get_stats()
+{
+    std::lock_guard<std::mutex> lock(outbound_m);
+    mqtt_stats stats = {
+        queued_count.load(),
+        dropped_count.load(),
+        published_count.load(),
+        delivered_count.load(),
+        failed_count.load(),
+        reconnect_count.load(),
+        connect_failed_count.load(),
+        stored_count.load(),
+        drained_count.load(),
+        outbox.overwritten(),
+        oversize_count.load(),
+        (int)inflight.size(),
+        outbound_size,
+        outbox.size(),
+        (mqtt_state)state.load()
+    };
+    return stats;
 }
 
 void mqtt_subscribe(std::string const &topic)
@@ -196,7 +650,13 @@ void mqtt_subscribe(std::string const &topic)
         return;
     }
 
-    MQTTClient_subscribe(client, topic.c_str(), 1);
+    {
+        std::lock_guard<std::mutex> lock(supervisor_m);
+        subscriptions.push_back(topic);
+    }
+    if (connected) {
+        MQTTClient_subscribe(client, topic.c_str(), QOS);
+    }
 }
 
 std::pair<mqtt_service_config, bool> get_mqtt_config()
@@ -214,6 +674,7 @@ std::pair<mqtt_service_config, bool> get_mqtt_config()
     mqtt_service_config config = {
         mqtt_server,
         mqtt_client_id,
+        std::string(),
         mqtt_username,
         mqtt_password,
         mqtt_cert,
@@ -0,0 +1,309 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "outbox.h"
+
+static const char OUTBOX_MAGIC[8] = {'D', 'M', 'O', 'U', 'T', 'B', 'X', '2'};
+// the records start on the page after the header
+static const size_t OUTBOX_HEADER_SIZE = 4096;
+
+// Header is at the start of the file. head and tail count the messages ever popped and pushed,
+// head_offset and tail_offset locate the oldest record and the end of the newest one in the ring,
+// used is the number of bytes between them, including the end of the ring skipped by a wrap.
+struct Outbox::Header
+{
+    char magic[8];
+    uint64_t area;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t head_offset;
+    uint64_t tail_offset;
+    uint64_t used;
+};
+
+// Record is followed by the topic and the payload. A record that does not fit before the end of the
+// ring starts over at its beginning, a size of 0 in place of the record tells the rest was skipped.
+// removed is set once the message was removed while older ones are still kept.
+struct Outbox::Record
+{
+    uint32_t size;
+    uint32_t topic_len;
+    uint32_t payload_len;
+    uint32_t removed;
+};
+
+size_t Outbox::recordSize(size_t topic_len, size_t payload_len)
+{
+    return (sizeof(Record) + topic_len + payload_len + 7) & ~(size_t)7;
+}
+
+Outbox::Outbox()
+    : fd(-1), map(nullptr), map_size(0), header(nullptr), area(0), removed(0), overwritten_count(0)
+{
+}
+
+Outbox::~Outbox()
+{
+    close();
+}
+
+bool Outbox::open(const std::string& path, size_t size)
+{
+    close();
+    size = std::max(size, (size_t)OUTBOX_MIN_SIZE) & ~(size_t)7;
+
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t file_size = OUTBOX_HEADER_SIZE + size;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || ((size_t)st.st_size != file_size && ftruncate(fd, file_size) != 0)) {
+        close();
+        return false;
+    }
+    bool resized = (size_t)st.st_size != file_size;
+
+    void* p = mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        return false;
+    }
+    map = (char*)p;
+    map_size = file_size;
+    header = (Header*)map;
+    area = size;
+
+    // start over unless the file holds an outbox of the same layout
+    bool same = !resized && memcmp(header->magic, OUTBOX_MAGIC, sizeof(OUTBOX_MAGIC)) == 0 &&
+                header->area == area && header->head <= header->tail &&
+                header->head_offset < area && header->used <= area;
+    if (!same) {
+        memcpy(header->magic, OUTBOX_MAGIC, sizeof(OUTBOX_MAGIC));
+        header->area = area;
+        clear();
+        return true;
+    }
+
+    // keep the records up to the first damaged one, the process may have died while writing it
+    uint64_t offset = header->head_offset;
+    uint64_t used = 0;
+    uint64_t count = 0;
+    for (; count < header->tail - header->head; count++) {
+        if (record(offset)->size == 0 && count > 0) {
+            used += area - offset;
+            offset = 0;
+        }
+        if (!valid(offset) || used + record(offset)->size > area) {
+            break;
+        }
+        offsets.push_back(offset);
+        removed += record(offset)->removed != 0;
+        used += record(offset)->size;
+        offset = (offset + record(offset)->size) % area;
+    }
+    header->tail = header->head + count;
+    header->tail_offset = offset;
+    header->used = used;
+    if (count == 0) {
+        clear();
+    }
+    trim();
+    return true;
+}
+
+void Outbox::close()
+{
+    if (map != nullptr) {
+        msync(map, map_size, MS_SYNC);
+        munmap(map, map_size);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    fd = -1;
+    map = nullptr;
+    map_size = 0;
+    header = nullptr;
+    area = 0;
+    offsets.clear();
+    removed = 0;
+}
+
+// clear empties the outbox and starts the ring over
+void Outbox::clear()
+{
+    header->head = header->tail;
+    header->head_offset = 0;
+    header->tail_offset = 0;
+    header->used = 0;
+    offsets.clear();
+    removed = 0;
+}
+
+Outbox::Record* Outbox::record(uint64_t offset) const
+{
+    return (Record*)(map + OUTBOX_HEADER_SIZE + offset);
+}
+
+// valid tells whether a whole record is at offset
+bool Outbox::valid(uint64_t offset) const
+{
+    if (offset + sizeof(Record) > area) {
+        return false;
+    }
+    const Record* r = record(offset);
+    return r->size % 8 == 0 && offset + r->size <= area &&
+           r->size >= recordSize(r->topic_len, r->payload_len) &&
+           (uint64_t)r->topic_len + r->payload_len <= area;
+}
+
+// skipWrap moves the head to the start of the ring when the rest of it was skipped
+void Outbox::skipWrap()
+{
+    if (header->tail > header->head && record(header->head_offset)->size == 0) {
+        header->used -= area - header->head_offset;
+        header->head_offset = 0;
+    }
+}
+
+// dropFront removes the oldest record
+void Outbox::dropFront()
+{
+    const Record* r = record(header->head_offset);
+    removed -= r->removed != 0;
+    header->used -= r->size;
+    header->head_offset = (header->head_offset + r->size) % area;
+    header->head++;
+    offsets.pop_front();
+    if (header->head == header->tail) {
+        clear();
+    }
+    skipWrap();
+}
+
+// trim drops the removed messages at the front, so their space can be reused
+void Outbox::trim()
+{
+    while (header->tail > header->head && record(header->head_offset)->removed) {
+        dropFront();
+    }
+}
+
+bool Outbox::push(const char* topic, size_t topic_len, const char* payload, size_t payload_len)
+{
+    size_t need = recordSize(topic_len, payload_len);
+    if (header == nullptr || need > area) {
+        return false;
+    }
+
+    // make room by overwriting the oldest messages, counting the end of the ring skipped if the record
+    // does not fit before it
+    size_t skipped;
+    for (;;) {
+        skipped = header->tail_offset + need > area ? area - header->tail_offset : 0;
+        if (header->used + skipped + need <= area) {
+            break;
+        }
+        overwritten_count += record(header->head_offset)->removed == 0;
+        dropFront();
+    }
+    if (skipped > 0) {
+        record(header->tail_offset)->size = 0;
+        header->used += skipped;
+        header->tail_offset = 0;
+    }
+
+    // fill the record before publishing it by moving the tail
+    Record* r = record(header->tail_offset);
+    r->size = need;
+    r->topic_len = topic_len;
+    r->payload_len = payload_len;
+    r->removed = 0;
+    char* data = (char*)(r + 1);
+    memcpy(data, topic, topic_len);
+    memcpy(data + topic_len, payload, payload_len);
+    offsets.push_back(header->tail_offset);
+    header->used += need;
+    header->tail_offset = (header->tail_offset + need) % area;
+    header->tail++;
+    return true;
+}
+
+bool Outbox::get(uint64_t seq, std::string& topic, std::string& payload) const
+{
+    if (header == nullptr || seq < header->head || seq >= header->tail) {
+        return false;
+    }
+    const Record* r = record(offsets[seq - header->head]);
+    if (r->removed) {
+        return false;
+    }
+
+    const char* data = (const char*)(r + 1);
+    topic.assign(data, r->topic_len);
+    payload.assign(data + r->topic_len, r->payload_len);
+    return true;
+}
+
+void Outbox::remove(uint64_t seq)
+{
+    if (header == nullptr || seq < header->head || seq >= header->tail) {
+        return;
+    }
+    Record* r = record(offsets[seq - header->head]);
+    if (!r->removed) {
+        r->removed = 1;
+        removed++;
+    }
+    trim();
+}
+
+uint64_t Outbox::first() const
+{
+    return header != nullptr ? header->head : 0;
+}
+
+uint64_t Outbox::end() const
+{
+    return header != nullptr ? header->tail : 0;
+}
+
+size_t Outbox::size() const
+{
+    return header != nullptr ? header->tail - header->head - removed : 0;
+}
+
+size_t Outbox::bytes() const
+{
+    return header != nullptr ? header->used : 0;
+}
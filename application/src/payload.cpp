@@ -0,0 +1,171 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <nlohmann/json.hpp>
+
+#include "payload.h"
+
+using json = nlohmann::json;
+
+// event codes of the binary telemetry schema
+enum TelemetryEvent { EVENT_INFO, EVENT_NEW, EVENT_DEFECT, EVENT_LEFT };
+
+static int eventCode(const char* event)
+{
+    if (strcmp(event, "new") == 0) {
+        return EVENT_NEW;
+    }
+    if (strcmp(event, "defect") == 0) {
+        return EVENT_DEFECT;
+    }
+    if (strcmp(event, "left") == 0) {
+        return EVENT_LEFT;
+    }
+    return EVENT_INFO;
+}
+
+// telemetryRecord returns the map of the binary telemetry schema. Every byte counts on metered links:
+// the keys are single characters, the event is a number, and the current info leaves out the part
+// when there is none.
+static json telemetryRecord(const Telemetry& t, bool versioned)
+{
+    int event = eventCode(t.event);
+    json record = json::object();
+    if (versioned) {
+        record["v"] = TELEMETRY_SCHEMA_VERSION;
+    }
+    record["s"] = t.stream;
+    record["e"] = event;
+    record["d"] = t.defect;
+    if (event != EVENT_INFO || t.area != 0) {
+        record["a"] = t.area;
+        record["r"] = {t.rect.x, t.rect.y, t.rect.width, t.rect.height};
+    }
+    record["p"] = t.total_parts;
+    record["f"] = t.total_defects;
+    record["t"] = t.timestamp;
+    return record;
+}
+
+void encodeTelemetry(const Telemetry& t, PayloadFormat format, std::vector<uint8_t>& out)
+{
+    out.clear();
+    if (format == PAYLOAD_MSGPACK) {
+        json::to_msgpack(telemetryRecord(t, true), out);
+    } else {
+        json::to_cbor(telemetryRecord(t, true), out);
+    }
+}
+
+void writeTelemetry(const Telemetry& t, JsonWriter& w)
+{
+    w.field("Stream", t.stream);
+    if (strcmp(t.event, "info") == 0) {
+        w.field("Defect", t.defect);
+        return;
+    }
+    w.field("Event", t.event)
+     .field("Defect", t.defect)
+     .field("Area", t.area)
+     .field("Parts", t.total_parts)
+     .field("Defects", t.total_defects)
+     .field("Time", t.timestamp);
+}
+
+TelemetryBatch::TelemetryBatch()
+    : max_count(1), max_age(0), seq(0)
+{
+}
+
+void TelemetryBatch::configure(size_t max_count, std::chrono::milliseconds max_age)
+{
+    this->max_count = max_count;
+    this->max_age = max_age;
+    items.reserve(max_count);
+}
+
+bool TelemetryBatch::add(const Telemetry& t)
+{
+    if (items.empty()) {
+        first = std::chrono::steady_clock::now();
+    }
+    items.push_back(t);
+    return items.size() >= max_count;
+}
+
+bool TelemetryBatch::due(std::chrono::steady_clock::time_point now) const
+{
+    return !items.empty() && now - first >= max_age;
+}
+
+std::chrono::milliseconds TelemetryBatch::timeLeft(std::chrono::steady_clock::time_point now,
+                                                   std::chrono::milliseconds limit) const
+{
+    if (items.empty()) {
+        return limit;
+    }
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(first + max_age - now);
+    return std::max(std::chrono::milliseconds(0), std::min(left, limit));
+}
+
+void TelemetryBatch::encode(PayloadFormat format, std::string& out)
+{
+    out.clear();
+    if (format == PAYLOAD_JSON) {
+        char number[24];
+        snprintf(number, sizeof(number), "%llu", (unsigned long long)seq);
+        out.append("{\"Seq\": \"").append(number).append("\", \"Messages\": [");
+        for (size_t i = 0; i < items.size(); i++) {
+            JsonWriter w;
+            writeTelemetry(items[i], w);
+            const char* msg = w.c_str();
+            if (i > 0) {
+                out.append(", ");
+            }
+            out.append(msg, w.size());
+        }
+        out.append("]}");
+    } else {
+        json record = {
+            {"v", TELEMETRY_SCHEMA_VERSION},
+            {"q", seq},
+            {"m", json::array()}
+        };
+        json& messages = record["m"];
+        for (auto& t : items) {
+            messages.push_back(telemetryRecord(t, false));
+        }
+        if (format == PAYLOAD_MSGPACK) {
+            json::to_msgpack(record, out);
+        } else {
+            json::to_cbor(record, out);
+        }
+    }
+
+    items.clear();
+    seq++;
+}
@@ -0,0 +1,253 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+#include "morphology.h"
+#include "preprocess.h"
+
+using namespace cv;
+
+void preprocess(const Mat& frame, Mat& mask, int thresh, StageClock* timer, BufferPool* pool)
+{
+    Size size(3,3);
+    Mat img, tmp;
+    if (pool) {
+        img = pool->acquire(frame.size(), CV_8UC1);
+        tmp = pool->acquire(frame.size(), CV_8UC1);
+    }
+
+    // a gray frame is blurred as it is, with no copy
+    Mat gray = frame;
+    if (frame.channels() == 2) {
+        extractChannel(frame, img, 0);
+        gray = img;
+    } else if (frame.channels() > 2) {
+        cvtColor(frame, img, COLOR_RGB2GRAY);
+        gray = img;
+    }
+    if (timer) timer->lap(STAGE_GRAY);
+    // Blur the image to smooth it before easier preprocessing, out of place so the filter needs no copy of its input.
+    // The frame may be a view of a region of interest: the border is isolated so the pixels around it are not read.
+    GaussianBlur(gray, tmp, size, 0, 0, BORDER_REFLECT_101 | BORDER_ISOLATED);
+    if (timer) timer->lap(STAGE_BLUR);
+
+    // Morphology: OPEN -> CLOSE -> OPEN
+    // MORPH_OPEN removes the noise and closes the "holes" in the background
+    // MORPH_CLOSE remove the noise and closes the "holes" in the foreground
+    morphologyCross(tmp, tmp, MORPH_OPEN, img);
+    morphologyCross(tmp, tmp, MORPH_CLOSE, img);
+    morphologyCross(tmp, tmp, MORPH_OPEN, img);
+    if (timer) timer->lap(STAGE_MORPHOLOGY);
+
+    // threshold the image to emphasize assembly part
+    threshold(tmp, mask, thresh, 255, THRESH_BINARY);
+    if (timer) timer->lap(STAGE_THRESHOLD);
+}
+
+void preprocessReference(const Mat& frame, Mat& mask, int thresh)
+{
+    static const Mat element = getStructuringElement(MORPH_ELLIPSE, Size(3,3));
+    Mat img;
+
+    // the copy isolates a region of interest from the rest of the frame, as the optimized paths do
+    if (frame.channels() == 1) {
+        frame.copyTo(img);
+    } else if (frame.channels() == 2) {
+        extractChannel(frame, img, 0);
+    } else {
+        cvtColor(frame, img, COLOR_RGB2GRAY);
+    }
+    GaussianBlur(img, img, Size(3,3), 0, 0);
+    morphologyEx(img, img, MORPH_OPEN, element);
+    morphologyEx(img, img, MORPH_CLOSE, element);
+    morphologyEx(img, img, MORPH_OPEN, element);
+    threshold(img, mask, thresh, 255, THRESH_BINARY);
+}
+
+// the fused pipeline: blur followed by OPEN (erode, dilate), CLOSE (dilate, erode) and OPEN (erode, dilate)
+enum FusedOp { OP_BLUR, OP_ERODE, OP_DILATE };
+static const FusedOp fused_ops[] = { OP_BLUR, OP_ERODE, OP_DILATE, OP_DILATE, OP_ERODE, OP_ERODE, OP_DILATE };
+static const int FUSED_STAGES = sizeof(fused_ops) / sizeof(fused_ops[0]);
+
+// grayRow matches cvtColor(COLOR_RGB2GRAY) on 8-bit data: 14-bit fixed point weights applied to R, G, B.
+// Gray frames are copied and the luma of YUYV frames is taken as it is.
+static void grayRow(const uchar* src, uchar* dst, int width, int channels)
+{
+    if (channels == 1) {
+        std::copy(src, src + width, dst);
+        return;
+    }
+    if (channels == 2) {
+        // YUYV, the luma is every other byte
+        for (int x = 0; x < width; x++) {
+            dst[x] = src[2 * x];
+        }
+        return;
+    }
+    for (int x = 0; x < width; x++, src += channels) {
+        dst[x] = (uchar)((src[0] * 4899 + src[1] * 9617 + src[2] * 1868 + (1 << 13)) >> 14);
+    }
+}
+
+// blurRow matches the bit-exact 3x3 GaussianBlur of 8-bit data: the [1 2 1] x [1 2 1] / 16 kernel,
+// rounded once, with BORDER_REFLECT_101 columns. Border rows are already reflected by the caller.
+static void blurRow(const uchar* up, const uchar* mid, const uchar* down, uchar* out, ushort* sums, int width)
+{
+    for (int x = 0; x < width; x++) {
+        sums[x] = (ushort)(up[x] + 2 * mid[x] + down[x]);
+    }
+
+    if (width == 1) {
+        out[0] = (uchar)((4 * sums[0] + 8) >> 4);
+        return;
+    }
+
+    out[0] = (uchar)((2 * sums[1] + 2 * sums[0] + 8) >> 4);
+    for (int x = 1; x < width - 1; x++) {
+        out[x] = (uchar)((sums[x - 1] + 2 * sums[x] + sums[x + 1] + 8) >> 4);
+    }
+    out[width - 1] = (uchar)((2 * sums[width - 2] + 2 * sums[width - 1] + 8) >> 4);
+}
+
+FusedPreprocessor::FusedPreprocessor()
+    : dst(nullptr), width(0), height(0), thresh(0)
+{
+}
+
+void FusedPreprocessor::run(const Mat& frame, Mat& mask, int thresh)
+{
+    this->width = frame.cols;
+    this->height = frame.rows;
+    this->thresh = thresh;
+
+    mask.create(height, width, CV_8UC1);
+    dst = &mask;
+    lines.resize(FUSED_STAGES * 3 * width);
+    sums.resize(width);
+
+    for (int y = 0; y < height; y++) {
+        grayRow(frame.ptr<uchar>(y), line(0, y), width, frame.channels());
+        feed(0, y);
+    }
+    dst = nullptr;
+}
+
+// line returns the buffer holding input row of a stage, each stage cycles through three rows
+uchar* FusedPreprocessor::line(int stage, int row)
+{
+    return &lines[(stage * 3 + row % 3) * width];
+}
+
+// feed is called once the input row of a stage is ready, and emits every output row it completes
+void FusedPreprocessor::feed(int stage, int row)
+{
+    if (row >= 1) {
+        emit(stage, row - 1);
+    }
+    if (row == height - 1) {
+        emit(stage, row);
+    }
+}
+
+// emit computes an output row of a stage and passes it on to the next one, the last stage thresholds into the mask
+void FusedPreprocessor::emit(int stage, int row)
+{
+    bool last = stage == FUSED_STAGES - 1;
+    const uchar* mid = line(stage, row);
+    uchar* out = last ? dst->ptr<uchar>(row) : line(stage + 1, row);
+
+    if (fused_ops[stage] == OP_BLUR) {
+        int up = row > 0 ? row - 1 : std::min(1, height - 1);
+        int down = row < height - 1 ? row + 1 : std::max(height - 2, 0);
+        blurRow(line(stage, up), mid, line(stage, down), out, &sums[0], width);
+    } else {
+        const uchar* up = row > 0 ? line(stage, row - 1) : nullptr;
+        const uchar* down = row < height - 1 ? line(stage, row + 1) : nullptr;
+        if (fused_ops[stage] == OP_ERODE) {
+            erodeCrossRow(up, mid, down, out, width);
+        } else {
+            dilateCrossRow(up, mid, down, out, width);
+        }
+    }
+
+    if (!last) {
+        feed(stage + 1, row);
+        return;
+    }
+
+    for (int x = 0; x < width; x++) {
+        out[x] = out[x] > thresh ? 255 : 0;
+    }
+}
+
+// Body preprocesses a range of bands
+class BandedPreprocessor::Body : public ParallelLoopBody
+{
+public:
+    Body(BandedPreprocessor& owner, const Mat& frame, Mat& mask, int thresh, int bands, bool fused)
+        : owner(owner), frame(frame), mask(mask), thresh(thresh), bands(bands), fused(fused) {}
+
+    void operator()(const Range& range) const
+    {
+        for (int i = range.start; i < range.end; i++) {
+            int y0 = frame.rows * i / bands;
+            int y1 = frame.rows * (i + 1) / bands;
+            int top = std::max(0, y0 - PREPROCESS_HALO);
+            int bottom = std::min(frame.rows, y1 + PREPROCESS_HALO);
+
+            Mat& band = owner.masks[i];
+            if (fused) {
+                owner.fusedPreprocessors[i].run(frame.rowRange(top, bottom), band, thresh);
+            } else {
+                preprocess(frame.rowRange(top, bottom), band, thresh, nullptr, &owner.pools[i]);
+            }
+            // the halo rows are only exact in the neighboring band
+            band.rowRange(y0 - top, y1 - top).copyTo(mask.rowRange(y0, y1));
+        }
+    }
+
+private:
+    BandedPreprocessor& owner;
+    const Mat& frame;
+    Mat& mask;
+    int thresh;
+    int bands;
+    bool fused;
+};
+
+void BandedPreprocessor::run(const Mat& frame, Mat& mask, int thresh, int bands, bool fused)
+{
+    // bands thinner than their halo would mostly compute rows thrown away
+    bands = std::max(1, std::min(bands, frame.rows / PREPROCESS_HALO));
+    if ((int)masks.size() < bands) {
+        masks.resize(bands);
+        fusedPreprocessors.resize(bands);
+        pools.resize(bands);
+    }
+
+    mask.create(frame.rows, frame.cols, CV_8UC1);
+    parallel_for_(Range(0, bands), Body(*this, frame, mask, thresh, bands, fused));
+}
@@ -0,0 +1,175 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <iomanip>
+
+#include "stats.h"
+
+static const char* stage_names[STAGE_COUNT] = {
+    "capture",
+    "gray",
+    "blur",
+    "morphology",
+    "threshold",
+    "preprocess",
+    "verify",
+    "blobs",
+    "select",
+    "frame"
+};
+
+const char* stageName(Stage stage)
+{
+    return stage < STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+// bucketIndex keeps values below 8 exact and splits every higher power of two into 8 buckets
+static int bucketIndex(uint64_t v)
+{
+    if (v < 8) {
+        return (int)v;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    return (msb - 2) * 8 + (int)((v >> (msb - 3)) & 7);
+}
+
+// bucketLimit returns the largest value that falls into the bucket
+static uint64_t bucketLimit(int index)
+{
+    if (index < 8) {
+        return index;
+    }
+    int msb = index / 8 + 2;
+    uint64_t sub = index % 8;
+    return ((8 + sub + 1) << (msb - 3)) - 1;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(uint64_t ns)
+{
+    buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t prev = maximum.load(std::memory_order_relaxed);
+    while (ns > prev && !maximum.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) {
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    for (int i = 0; i < BUCKETS; i++) {
+        buckets[i].store(0, std::memory_order_relaxed);
+    }
+    total.store(0, std::memory_order_relaxed);
+    maximum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::max() const
+{
+    return maximum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::percentile(double p) const
+{
+    uint64_t n = count();
+    if (n == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p / 100.0 * n + 0.5);
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            // the bucket limit can overshoot the largest sample actually recorded
+            uint64_t limit = bucketLimit(i);
+            uint64_t top = max();
+            return limit < top ? limit : top;
+        }
+    }
+    return max();
+}
+
+void PipelineStats::reset()
+{
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        stages[i].reset();
+    }
+}
+
+void printStats(std::ostream& out, const PipelineStats& stats)
+{
+    out << std::left << std::setw(12) << "stage (ms)" << std::right
+        << std::setw(10) << "count"
+        << std::setw(10) << "p50"
+        << std::setw(10) << "p95"
+        << std::setw(10) << "p99"
+        << std::setw(10) << "max" << "\n";
+
+    out << std::fixed << std::setprecision(3);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const LatencyHistogram& h = stats.stages[i];
+        if (h.count() == 0) {
+            continue;
+        }
+        out << std::left << std::setw(12) << stageName((Stage)i) << std::right
+            << std::setw(10) << h.count()
+            << std::setw(10) << h.percentile(50) / 1e6
+            << std::setw(10) << h.percentile(95) / 1e6
+            << std::setw(10) << h.percentile(99) / 1e6
+            << std::setw(10) << h.max() / 1e6 << "\n";
+    }
+    out.unsetf(std::ios::floatfield);
+}
+
+nlohmann::json statsJson(const PipelineStats& stats)
+{
+    nlohmann::json stages = nlohmann::json::object();
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const LatencyHistogram& h = stats.stages[i];
+        if (h.count() == 0) {
+            continue;
+        }
+        stages[stageName((Stage)i)] = {
+            {"count", h.count()},
+            {"p50", h.percentile(50) / 1e6},
+            {"p95", h.percentile(95) / 1e6},
+            {"p99", h.percentile(99) / 1e6},
+            {"max", h.max() / 1e6}
+        };
+    }
+    return stages;
+}
@@ -0,0 +1,357 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#include "v4l2_capture.h"
+
+using namespace cv;
+
+#if CV_VERSION_MAJOR >= 4
+typedef AccessFlag AccessFlags;
+#else
+typedef int AccessFlags;
+#endif
+
+// Allocator gives a buffer back to its V4L2Capture once the last Mat sharing it is released.
+// It never allocates anything itself.
+class V4L2Capture::Allocator : public MatAllocator
+{
+public:
+    explicit Allocator(V4L2Capture& owner) : owner(owner) {}
+
+    UMatData* allocate(int, const int*, int, void*, size_t*, AccessFlags, UMatUsageFlags) const
+    {
+        return nullptr;
+    }
+
+    bool allocate(UMatData*, AccessFlags, UMatUsageFlags) const
+    {
+        return false;
+    }
+
+    void deallocate(UMatData* u) const
+    {
+        owner.release((int)(intptr_t)u->userdata);
+        delete u;
+    }
+
+private:
+    V4L2Capture& owner;
+};
+
+// xioctl retries the ioctls interrupted by a signal
+static int xioctl(int fd, unsigned long request, void* arg)
+{
+    int r;
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+V4L2Capture::V4L2Capture()
+    : fd(-1), width(0), height(0), stride(0), pixel_format(0), frame_rate(0),
+      allocator(new Allocator(*this)), current(-1), queued(0), streaming(false)
+{
+}
+
+V4L2Capture::~V4L2Capture()
+{
+    close();
+}
+
+bool V4L2Capture::open(int index, int count)
+{
+    close();
+    // the buffers of the previous device are forgotten once all its frames are released
+    if (!buffers.empty()) {
+        return false;
+    }
+
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/video%d", index);
+    fd = ::open(path, O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+
+    v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(fd, VIDIOC_QUERYCAP, &cap) < 0) {
+        close();
+        return false;
+    }
+    unsigned caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS) ? cap.device_caps : cap.capabilities;
+    if (!(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING)) {
+        close();
+        return false;
+    }
+
+    // keep the resolution the camera is set to, only the pixel format changes
+    v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if (xioctl(fd, VIDIOC_G_FMT, &fmt) < 0) {
+        close();
+        return false;
+    }
+    const unsigned formats[] = { V4L2_PIX_FMT_GREY, V4L2_PIX_FMT_YUYV };
+    pixel_format = 0;
+    for (unsigned f : formats) {
+        fmt.fmt.pix.pixelformat = f;
+        fmt.fmt.pix.bytesperline = 0;
+        if (xioctl(fd, VIDIOC_S_FMT, &fmt) == 0 && fmt.fmt.pix.pixelformat == f) {
+            pixel_format = f;
+            break;
+        }
+    }
+    if (pixel_format == 0) {
+        close();
+        return false;
+    }
+    width = fmt.fmt.pix.width;
+    height = fmt.fmt.pix.height;
+    size_t pixel_size = pixel_format == V4L2_PIX_FMT_GREY ? 1 : 2;
+    stride = std::max((size_t)fmt.fmt.pix.bytesperline, width * pixel_size);
+
+    v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    frame_rate = 0;
+    if (xioctl(fd, VIDIOC_G_PARM, &parm) == 0 && parm.parm.capture.timeperframe.numerator > 0) {
+        frame_rate = (double)parm.parm.capture.timeperframe.denominator / parm.parm.capture.timeperframe.numerator;
+    }
+
+    v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count = count;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2) {
+        close();
+        return false;
+    }
+
+    for (unsigned i = 0; i < req.count; i++) {
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(fd, VIDIOC_QUERYBUF, &buf) < 0) {
+            close();
+            return false;
+        }
+        void* start = mmap(nullptr, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, buf.m.offset);
+        if (start == MAP_FAILED || buf.length < stride * height) {
+            if (start != MAP_FAILED) {
+                munmap(start, buf.length);
+            }
+            close();
+            return false;
+        }
+        buffers.push_back(Buffer{start, buf.length, false});
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m);
+        bool queued_all = true;
+        for (size_t i = 0; i < buffers.size() && queued_all; i++) {
+            queued_all = queue((int)i);
+        }
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        streaming = queued_all && xioctl(fd, VIDIOC_STREAMON, &type) == 0;
+    }
+    if (!streaming) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void V4L2Capture::close()
+{
+    std::lock_guard<std::mutex> lock(m);
+    if (fd < 0) {
+        return;
+    }
+
+    if (streaming) {
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        xioctl(fd, VIDIOC_STREAMOFF, &type);
+        streaming = false;
+    }
+    // the buffers still in Mats are unmapped when they are released
+    bool held = false;
+    for (Buffer& b : buffers) {
+        if (!b.held && b.start) {
+            munmap(b.start, b.length);
+            b.start = nullptr;
+        }
+        held = held || b.held;
+    }
+    if (!held) {
+        buffers.clear();
+    }
+    ::close(fd);
+    fd = -1;
+    current = -1;
+    queued = 0;
+}
+
+// queue hands a buffer to the driver to capture into, the caller holds m
+bool V4L2Capture::queue(int index)
+{
+    v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = index;
+    if (xioctl(fd, VIDIOC_QBUF, &buf) < 0) {
+        return false;
+    }
+    queued++;
+    return true;
+}
+
+// release is called by the allocator once the frame of the buffer is no longer in any Mat
+void V4L2Capture::release(int index)
+{
+    std::lock_guard<std::mutex> lock(m);
+    Buffer& b = buffers[index];
+    b.held = false;
+    if (fd >= 0) {
+        queue(index);
+        returned.notify_one();
+    } else {
+        munmap(b.start, b.length);
+        b.start = nullptr;
+        bool held = false;
+        for (const Buffer& other : buffers) {
+            held = held || other.held;
+        }
+        if (!held) {
+            buffers.clear();
+        }
+    }
+}
+
+bool V4L2Capture::grab()
+{
+    if (fd < 0) {
+        return false;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m);
+        // a frame grabbed but never retrieved goes straight back to the driver
+        if (current >= 0) {
+            queue(current);
+            current = -1;
+        }
+        // every buffer may be held by frames still in the pipeline, the driver needs one to capture into
+        if (!returned.wait_for(lock, std::chrono::milliseconds(V4L2_TIMEOUT_MS), [this] { return queued > 0; })) {
+            return false;
+        }
+    }
+
+    for (;;) {
+        pollfd p = { fd, POLLIN, 0 };
+        int r = poll(&p, 1, V4L2_TIMEOUT_MS);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            return false;
+        }
+
+        v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(fd, VIDIOC_DQBUF, &buf) < 0) {
+            if (errno == EAGAIN) {
+                continue;
+            }
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m);
+        queued--;
+        // a damaged frame is captured again
+        if (buf.flags & V4L2_BUF_FLAG_ERROR) {
+            queue(buf.index);
+            continue;
+        }
+        current = buf.index;
+        return true;
+    }
+}
+
+bool V4L2Capture::retrieve(Mat& frame)
+{
+    if (current < 0) {
+        return false;
+    }
+
+    Buffer& b = buffers[current];
+    Mat view(height, width, pixel_format == V4L2_PIX_FMT_GREY ? CV_8UC1 : CV_8UC2, b.start, stride);
+    UMatData* u = new UMatData(allocator.get());
+    u->data = u->origdata = (uchar*)b.start;
+    u->size = b.length;
+    u->userdata = (void*)(intptr_t)current;
+    u->refcount = 1;
+    // the release goes through u->currAllocator; view.allocator stays null, or every Mat created
+    // from a copy of the frame would ask this allocator for its memory
+    view.u = u;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        b.held = true;
+    }
+    current = -1;
+
+    frame = view;
+    return true;
+}
+
+std::string V4L2Capture::format() const
+{
+    std::string name(4, ' ');
+    for (int i = 0; i < 4; i++) {
+        name[i] = (char)((pixel_format >> (8 * i)) & 0xff);
+    }
+    return name;
+}
@@ -0,0 +1,65 @@
+/*
+* Copyright (c) 2018 Intel Corporation.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+* LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+* OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+* WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "work_signal.h"
+
+WorkSignal::WorkSignal()
+    : posted(0),
+      waiters(0),
+      stopped(false)
+{
+}
+
+void WorkSignal::post()
+{
+    posted.fetch_add(1);
+    if (waiters.load() > 0) {
+        // taking the lock makes sure the waiter is either before its check or inside cv.wait
+        std::lock_guard<std::mutex> lock(m);
+        cv.notify_one();
+    }
+}
+
+uint64_t WorkSignal::ticket() const
+{
+    return posted.load();
+}
+
+bool WorkSignal::wait(uint64_t ticket)
+{
+    std::unique_lock<std::mutex> lock(m);
+    waiters.fetch_add(1);
+    while (posted.load() == ticket && !stopped.load()) {
+        cv.wait(lock);
+    }
+    waiters.fetch_sub(1);
+
+    return !stopped.load();
+}
+
+void WorkSignal::shutdown()
+{
+    std::lock_guard<std::mutex> lock(m);
+    stopped.store(true);
+    cv.notify_all();
+}